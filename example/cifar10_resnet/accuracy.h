@@ -2,8 +2,7 @@
 
 #include <tnn/tnn.h>
 
-// shapes = (N, C)
-// pred contains logits, target is one-hot encoded
+// pred contains logits (N, C), target contains class indices (N)
 float accuracy(tnn_tensor_t *pred, tnn_tensor_t *target) {
 	size_t batch_size = pred->dims[0];
 	size_t num_classes = pred->dims[1];
@@ -19,13 +18,7 @@ float accuracy(tnn_tensor_t *pred, tnn_tensor_t *target) {
 				pred_label = c;
 			}
 		}
-		size_t true_label = 0;
-		for (size_t c = 0; c < num_classes; c++) {
-			if (target->data[n * num_classes + c] > 0.5f) {
-				true_label = c;
-				break;
-			}
-		}
+		size_t true_label = (size_t)target->data[n];
 		if (pred_label == true_label) {
 			correct++;
 		}
@@ -14,7 +14,7 @@
 
 typedef struct {
 	float *imgs;
-	float *labels;
+	float *labels; // class indices
 	size_t num_imgs;
 	size_t capacity;
 } cifar10_t;
@@ -56,9 +56,7 @@ static int cifar10_load(cifar10_t *cifar, const char *data_path) {
 	if (new_total > cifar->capacity) {
 		float *new_imgs =
 		    realloc(cifar->imgs, new_total * image_size * sizeof(float));
-		float *new_labels = realloc(
-		    cifar->labels, new_total * CIFAR10_NUM_LABELS * sizeof(float)
-		);
+		float *new_labels = realloc(cifar->labels, new_total * sizeof(float));
 
 		if (!new_imgs || !new_labels) {
 			fprintf(stderr, "failed to allocate memory for dataset\n");
@@ -68,12 +66,6 @@ static int cifar10_load(cifar10_t *cifar, const char *data_path) {
 			return CIFAR10_LOAD_ERROR;
 		}
 
-		memset(
-		    new_labels + cifar->capacity * CIFAR10_NUM_LABELS,
-		    0,
-		    (new_total - cifar->capacity) * CIFAR10_NUM_LABELS * sizeof(float)
-		);
-
 		cifar->imgs = new_imgs;
 		cifar->labels = new_labels;
 		cifar->capacity = new_total;
@@ -92,7 +84,7 @@ static int cifar10_load(cifar10_t *cifar, const char *data_path) {
 
 		uint8_t label = rec_buf[0];
 		size_t img_idx = start_idx + i;
-		cifar->labels[img_idx * CIFAR10_NUM_LABELS + label] = 1.0f;
+		cifar->labels[img_idx] = label;
 
 		uint8_t *pixels = rec_buf + 1;
 		for (size_t c = 0; c < CIFAR10_CHANNELS; c++) {
@@ -134,8 +126,7 @@ static void cifar10_make_batch(
 		tnn_init_from_memory(*img, &cifar->imgs[offset]);
 	}
 	if (label) {
-		size_t offset = start_idx * CIFAR10_NUM_LABELS;
-		*label = tnn_alloc((size_t[]){batch_size, CIFAR10_NUM_LABELS}, 2);
-		tnn_init_from_memory(*label, &cifar->labels[offset]);
+		*label = tnn_alloc((size_t[]){batch_size}, 1);
+		tnn_init_from_memory(*label, &cifar->labels[start_idx]);
 	}
 }
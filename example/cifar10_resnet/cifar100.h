@@ -14,8 +14,8 @@
 
 typedef struct {
 	float *imgs;
-	float *labels;
-	float *categories;
+	float *labels;     // class indices
+	float *categories; // class indices
 } cifar100_t;
 
 static void cifar100_create(cifar100_t *cifar) {
@@ -23,10 +23,8 @@ static void cifar100_create(cifar100_t *cifar) {
 	    CIFAR100_NUM_IMGS * CIFAR100_HEIGHT * CIFAR100_WIDTH *
 	    CIFAR100_CHANNELS * sizeof(float)
 	);
-	cifar->labels =
-	    calloc(CIFAR100_NUM_IMGS * CIFAR100_NUM_LABELS, sizeof(float));
-	cifar->categories =
-	    calloc(CIFAR100_NUM_IMGS * CIFAR100_NUM_CATEGORIES, sizeof(float));
+	cifar->labels = malloc(CIFAR100_NUM_IMGS * sizeof(float));
+	cifar->categories = malloc(CIFAR100_NUM_IMGS * sizeof(float));
 }
 
 static void cifar100_destroy(cifar100_t *cifar) {
@@ -76,8 +74,8 @@ static int cifar100_load(cifar100_t *cifar, const char *data_path) {
 		uint8_t coarse_label = rec_buf[0];
 		uint8_t fine_label = rec_buf[1];
 
-		cifar->categories[i * CIFAR100_NUM_CATEGORIES + coarse_label] = 1.0f;
-		cifar->labels[i * CIFAR100_NUM_LABELS + fine_label] = 1.0f;
+		cifar->categories[i] = coarse_label;
+		cifar->labels[i] = fine_label;
 
 		uint8_t *pixels = rec_buf + 2;
 		for (size_t c = 0; c < CIFAR100_CHANNELS; c++) {
@@ -119,14 +117,11 @@ static void cifar100_make_batch(
 		tnn_init_from_memory(*img, &cifar->imgs[offset]);
 	}
 	if (label != NULL) {
-		size_t offset = start_idx * CIFAR100_NUM_LABELS;
-		*label = tnn_alloc((size_t[]){batch_size, CIFAR100_NUM_LABELS}, 2);
-		tnn_init_from_memory(*label, &cifar->labels[offset]);
+		*label = tnn_alloc((size_t[]){batch_size}, 1);
+		tnn_init_from_memory(*label, &cifar->labels[start_idx]);
 	}
 	if (category != NULL) {
-		size_t offset = start_idx * CIFAR100_NUM_CATEGORIES;
-		*category =
-		    tnn_alloc((size_t[]){batch_size, CIFAR100_NUM_CATEGORIES}, 2);
-		tnn_init_from_memory(*category, &cifar->categories[offset]);
+		*category = tnn_alloc((size_t[]){batch_size}, 1);
+		tnn_init_from_memory(*category, &cifar->categories[start_idx]);
 	}
 }
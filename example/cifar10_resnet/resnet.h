@@ -2,23 +2,31 @@
 
 #include <tnn/tnn.h>
 
+// TNN_CONV_BN_CFG() fields override its defaults
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
 static inline tnn_tensor_t *
 resnet_block(tnn_tensor_t *x, size_t dim_out, size_t stride) {
 	tnn_tensor_t *skip = x;
 
 	TNN_SCOPE("conv1") {
-		x = tnn_relu(tnn_bn(tnn_conv(x, dim_out, 3, stride, 1)));
-	}
-	TNN_SCOPE("conv2") {
-		x = tnn_bn(tnn_conv(x, dim_out, 3, 1, 1));
+		x = tnn_conv_bn(x, dim_out, TNN_CONV_BN_CFG(.stride = stride));
 	}
 	if (stride != 1) {
 		TNN_SCOPE("skip") {
-			skip = tnn_bn(tnn_conv(skip, dim_out, 1, stride, 0));
+			tnn_conv_bn_cfg_t cfg = TNN_CONV_BN_CFG(
+			    .kernel_size = 1, .stride = stride, .padding = 0, .relu = false
+			);
+			skip = tnn_conv_bn(skip, dim_out, cfg);
 		}
 	}
-	return tnn_relu(tnn_add(x, skip));
+	// relu(bn(conv(x)) + skip)
+	TNN_SCOPE("conv2") {
+		x = tnn_conv_bn(x, dim_out, TNN_CONV_BN_CFG(.skip = skip));
+	}
+	return x;
 }
+#pragma GCC diagnostic pop
 
 static inline tnn_tensor_t *resnet_layer(
     tnn_tensor_t *x, size_t dim_out, size_t num_blocks, size_t stride
@@ -41,7 +49,7 @@ static inline tnn_tensor_t *resnet(
 ) {
 	TNN_SCOPE("resnet") {
 		TNN_SCOPE("init") {
-			x = tnn_relu(tnn_bn(tnn_conv(x, base_dim, 3, 1, 1)));
+			x = tnn_conv_bn(x, base_dim);
 		}
 		for (size_t i = 0; i < num_layers; i++) {
 			size_t dim_out = base_dim * (1 << (i + 1));
@@ -16,17 +16,17 @@ typedef struct {
 tnn_tensor_t *mlp(tnn_tensor_t *input, mlp_cfg_t cfg) {
 	TNN_SCOPE("mlp") {
 		TNN_SCOPE("in") {
-			input = tnn_relu(tnn_bias(tnn_proj(input, cfg.dim_hidden)));
+			input = tnn_linear(input, cfg.dim_hidden, TNN_ACT_RELU);
 		}
 		TNN_SCOPE("hidden") {
 			for (size_t i = 0; i < cfg.num_hidden; i++) {
 				TNN_SCOPE("%zu", i) {
-					input = tnn_relu(tnn_bias(tnn_proj(input, cfg.dim_hidden)));
+					input = tnn_linear(input, cfg.dim_hidden, TNN_ACT_RELU);
 				}
 			}
 		}
 		TNN_SCOPE("out") {
-			input = tnn_bias(tnn_proj(input, cfg.dim_out));
+			input = tnn_linear(input, cfg.dim_out);
 		}
 	}
 	return input;
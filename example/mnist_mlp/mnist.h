@@ -10,7 +10,7 @@ typedef struct {
 	size_t num_rows;
 	size_t num_cols;
 	float *images; // flattened images data (num_images * num_rows * num_cols)
-	float *labels; // one-hot encoded labels (num_images * 10)
+	float *labels; // class indices (num_images)
 } mnist_t;
 
 // Helper function to read big-endian 32-bit integer
@@ -109,11 +109,10 @@ mnist_load(mnist_t *mnist, const char *images_path, const char *labels_path) {
 	uint8_t *raw_labels = malloc(num_labels);
 	fread(raw_labels, 1, num_labels, labels_file);
 	fclose(labels_file);
-	// one-hot encode and save to mnist->labels
-	mnist->labels = calloc(num_labels * 10, sizeof(float));
+	// save class indices to mnist->labels
+	mnist->labels = malloc(num_labels * sizeof(float));
 	for (size_t i = 0; i < num_labels; i++) {
-		uint8_t label = raw_labels[i];
-		mnist->labels[i * 10 + label] = 1.0f;
+		mnist->labels[i] = raw_labels[i];
 	}
 	free(raw_labels);
 }
@@ -143,9 +142,8 @@ mnist_batch_labels(mnist_t *mnist, size_t start_idx, size_t batch_size) {
 		batch_size = mnist->num_images - start_idx;
 	}
 
-	// Create tensor directly from the offset buffer (already one-hot encoded)
-	size_t offset = start_idx * 10;
-	tnn_tensor_t *batch = tnn_alloc((size_t[]){batch_size, 10}, 2);
-	tnn_init_from_memory(batch, &mnist->labels[offset]);
+	// Create tensor directly from the offset buffer (class indices)
+	tnn_tensor_t *batch = tnn_alloc((size_t[]){batch_size}, 1);
+	tnn_init_from_memory(batch, &mnist->labels[start_idx]);
 	return batch;
 }
@@ -33,7 +33,7 @@ int main() {
 			    mnist_batch_labels(&mnist, i * batch_size, batch_size);
 
 			tnn_tensor_t *y_pred = mlp(x, mlp_cfg);
-			tnn_tensor_t *loss = tnn_cross_entropy(y_pred, y);
+			tnn_tensor_t *loss = tnn_sparse_cross_entropy(y_pred, y);
 
 			tnn_zero_grad();
 			tnn_backward(loss);
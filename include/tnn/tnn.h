@@ -30,6 +30,25 @@ typedef struct tnn_tensor {
 	void (*backward)(struct tnn_tensor *);
 	void *context; // pass more info from forward to backward
 	void (*free_context)(void *);
+
+	// data points into a file mapping instead of the heap, see: tnn_load() and
+	// tnn_offload()
+	struct tnn_mapping *mapping;
+
+	// backward doesn't read own data (compact) or data of parents[i] (bit i of
+	// compact_parents), see: tnn_compact_activations()
+	bool compact;
+	uint16_t compact_parents;
+
+	// channels of a blocked tensor, its last dim being padded, see:
+	// tnn_to_blocked(); 0 for plain tensors
+	size_t channels;
+
+	// bumped when data is rewritten in place (tnn_init_*(), optimizer steps,
+	// tnn_fold_bn()), code writing data directly must bump it too; packed
+	// copies of older versions get repacked, see: tnn_prepack()
+	uint64_t version;
+	struct tnn_packed *packed;
 } tnn_tensor_t;
 
 tnn_tensor_t *tnn_alloc(const size_t *dims, size_t num_dims);
@@ -51,7 +70,7 @@ tnn_tensor_t *tnn_detach_free(tnn_tensor_t *t);
 
 void tnn_init_from_memory(tnn_tensor_t *t, const float *data);
 void tnn_init_fill(tnn_tensor_t *t, float value);
-void tnn_init_randn(tnn_tensor_t *t);
+void tnn_init_randn(tnn_tensor_t *t); // draws a fresh stream, see: tnn_seed()
 
 size_t tnn_dim(tnn_tensor_t *t, int32_t i_dim);
 size_t tnn_size(tnn_tensor_t *t);
@@ -83,23 +102,111 @@ float tnn_item(tnn_tensor_t *t);
 // impl: src/state.c
 ///
 
+// (re)initializes the default context, which every thread without a bound
+// context works on
 int tnn_init();
 void tnn_terminate();
 
+// a context owns a state dict, active scope, rng stream and mode flags
+// - shared: state lookups that miss fall back to it, e.g. N inference workers
+//   on one copy of the weights; may be NULL
+// - shared state is read-only while other contexts use it: no training,
+//   loading or tnn_bn() without test mode through a sharing context
+// - tensors themselves are not tied to a context
+typedef struct tnn_ctx tnn_ctx_t;
+tnn_ctx_t *tnn_ctx_create(tnn_ctx_t *shared);
+void tnn_ctx_destroy(tnn_ctx_t *ctx);
+
+// binds ctx to the calling thread (NULL for the default context), returns
+// the previously used one
+tnn_ctx_t *tnn_ctx_bind(tnn_ctx_t *ctx);
+tnn_ctx_t *tnn_ctx_current();
+
 void tnn_push(const char *key_fmt, ...);
 void tnn_pop();
 #define TNN_SCOPE(key_fmt, ...)                                                \
 	for (int _tnn_once = (tnn_push(key_fmt, ##__VA_ARGS__), 1); _tnn_once;     \
 	     tnn_pop(), _tnn_once = 0)
 
-void tnn_save(const char *filename);
-void tnn_load(const char *filename);
-
 size_t tnn_list_state_keys(char **out_keys);
 tnn_tensor_t *tnn_get_state(const char *key);
 void tnn_set_state(const char *key, tnn_tensor_t *value);
 void tnn_drop_state(const char *key);
 
+///
+// RANDOM NUMBERS
+// impl: src/rng.c
+///
+
+// seeds the current context (a fixed default is used otherwise)
+// - weight init draws from a counter-based philox stream keyed by the seed
+//   and the full state key, results don't depend on thread count or on the
+//   order layers get created in
+// - tnn_init_randn() streams are numbered per context in call order
+void tnn_seed(uint64_t seed);
+
+///
+// BACKENDS
+// impl: src/backend.c
+///
+
+// kernel set picked by tnn_init(): the best one the cpu supports
+// (avx512vnni, avx512, avxvnni, avx2, sse4 or scalar), or the one named by the
+// TNN_BACKEND environment variable, e.g. for comparing them
+// - the vnni ones only differ in their int8 dots, see: tnn_quantize()
+// - results may differ between backends in the last bits
+const char *tnn_backend_name();
+
+///
+// CONV AUTOTUNING
+// impl: src/autotune.c
+///
+
+// while enabled, the first tnn_conv() or tnn_conv_bn() of each shape times
+// the conv algorithms (direct, im2col) on its input and keeps the fastest
+// - winners are appended to cache_path (created if missing) per cpu model
+//   and backend, and read back from it when enabled again, e.g. next run
+// - process-wide, call after tnn_init()
+// - results may differ between algorithms in the last bits
+// - NULL (default) disables it: direct convs, 1x1 as gemm
+void tnn_conv_autotune(const char *cache_path);
+
+///
+// CHECKPOINTS
+// impl: src/checkpoint.c
+///
+
+// writes state under the active scope: a header and key index with content
+// hashes, followed by 64-byte aligned tensor payloads
+void tnn_save(const char *filename);
+
+// like tnn_save() but only writes tensors that are new or differ from the
+// latest version along base_filename's delta chain, tnn_load() resolves the
+// chain
+// - keys dropped since the base still load from the base
+void tnn_save_delta(const char *filename, const char *base_filename);
+
+// snapshots state under the active scope into a staging copy, then writes and
+// fsyncs it on a background thread
+// - the file appears atomically (renamed from "<filename>.tmp") when done
+// - every job must be finished with tnn_save_wait()
+typedef struct tnn_save_job tnn_save_job_t;
+tnn_save_job_t *tnn_save_async(const char *filename);
+bool tnn_save_poll(tnn_save_job_t *job); // true once written
+int tnn_save_wait(tnn_save_job_t *job);  // 0 on success, frees job
+
+// maps the file and hands out state tensors pointing straight into the
+// mapping (copy-on-write once written to), legacy v1 files are read and copied
+// - lazy: only the index is read, each tensor materializes on its first
+//   tnn_get_state() or tnn_alloc_or_get_state() hit (v2 files only)
+void _tnn_load(const char *filename, bool lazy);
+#define tnn_load(...) OPTARG_FUNC(tnn_load, __VA_ARGS__)
+#define tnn_load_1(filename) _tnn_load(filename, false)
+#define tnn_load_2(filename, lazy) _tnn_load(filename, lazy)
+
+// hints that lazily loaded tensors under scope will be needed soon
+void tnn_prefetch(const char *scope);
+
 ///
 // TENSOR OPERATIONS
 // impl: src/ops/*.c
@@ -113,10 +220,47 @@ tnn_tensor_t *tnn_bias(tnn_tensor_t *input);
 tnn_tensor_t *tnn_relu(tnn_tensor_t *input);
 tnn_tensor_t *tnn_add(tnn_tensor_t *a, tnn_tensor_t *b);
 
-tnn_tensor_t *_tnn_mean(tnn_tensor_t *input, size_t i_dim, size_t num_dims);
+typedef enum {
+	TNN_ACT_NONE,
+	TNN_ACT_RELU,
+} tnn_act_t;
+
+// fused act(bias(proj(input))), bias and activation are applied to output
+// tiles while they're still in cache, only the output is kept for backward
+// - same state keys as the unfused chain, checkpoints are interchangeable
+tnn_tensor_t *_tnn_linear(tnn_tensor_t *input, size_t dim_out, tnn_act_t act);
+#define tnn_linear(...) OPTARG_FUNC(tnn_linear, __VA_ARGS__)
+#define tnn_linear_2(input, dim_out) _tnn_linear(input, dim_out, TNN_ACT_NONE)
+#define tnn_linear_3(input, dim_out, act) _tnn_linear(input, dim_out, act)
+
+typedef enum {
+	TNN_REDUCE_SUM,
+	TNN_REDUCE_MEAN,
+	TNN_REDUCE_MAX,
+	TNN_REDUCE_MIN,
+} tnn_reduce_op_t;
+
+// reduces dims [i_dim, i_dim + num_dims) of input
+// - max/min pass the gradient to the first extremal element
+tnn_tensor_t *_tnn_reduce(
+    tnn_tensor_t *input, tnn_reduce_op_t op, size_t i_dim, size_t num_dims
+);
+#define tnn_sum(...) OPTARG_FUNC(tnn_sum, __VA_ARGS__)
+#define tnn_sum_2(input, i_dim) _tnn_reduce(input, TNN_REDUCE_SUM, i_dim, 1)
+#define tnn_sum_3(input, i_dim, num_dims)                                      \
+	_tnn_reduce(input, TNN_REDUCE_SUM, i_dim, num_dims)
 #define tnn_mean(...) OPTARG_FUNC(tnn_mean, __VA_ARGS__)
-#define tnn_mean_2(input, i_dim) _tnn_mean(input, i_dim, 1)
-#define tnn_mean_3(input, i_dim, num_dims) _tnn_mean(input, i_dim, num_dims)
+#define tnn_mean_2(input, i_dim) _tnn_reduce(input, TNN_REDUCE_MEAN, i_dim, 1)
+#define tnn_mean_3(input, i_dim, num_dims)                                     \
+	_tnn_reduce(input, TNN_REDUCE_MEAN, i_dim, num_dims)
+#define tnn_max(...) OPTARG_FUNC(tnn_max, __VA_ARGS__)
+#define tnn_max_2(input, i_dim) _tnn_reduce(input, TNN_REDUCE_MAX, i_dim, 1)
+#define tnn_max_3(input, i_dim, num_dims)                                      \
+	_tnn_reduce(input, TNN_REDUCE_MAX, i_dim, num_dims)
+#define tnn_min(...) OPTARG_FUNC(tnn_min, __VA_ARGS__)
+#define tnn_min_2(input, i_dim) _tnn_reduce(input, TNN_REDUCE_MIN, i_dim, 1)
+#define tnn_min_3(input, i_dim, num_dims)                                      \
+	_tnn_reduce(input, TNN_REDUCE_MIN, i_dim, num_dims)
 
 tnn_tensor_t *_tnn_bn(tnn_tensor_t *input, float momentum, bool test);
 #define tnn_bn(...) OPTARG_FUNC(tnn_bn, __VA_ARGS__)
@@ -128,6 +272,19 @@ tnn_tensor_t *_tnn_bn(tnn_tensor_t *input, float momentum, bool test);
 // - target is one-hot encoded 2D [batch_size, num_classes]
 tnn_tensor_t *tnn_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target);
 
+// - pred is raw logits 2D [batch_size, num_classes]
+// - target is class indices 1D [batch_size], stored as floats
+tnn_tensor_t *
+tnn_sparse_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target);
+
+// fused tnn_sparse_cross_entropy(tnn_proj(input, num_classes), target),
+// logits are streamed over class chunks and never materialized
+// - input is 2D [batch_size, dim_in]
+// - target is class indices 1D [batch_size], stored as floats
+tnn_tensor_t *tnn_proj_cross_entropy(
+    tnn_tensor_t *input, size_t num_classes, tnn_tensor_t *target
+);
+
 // input dim is [..., height, width, in_channels]
 tnn_tensor_t *_tnn_conv(
     tnn_tensor_t *input,
@@ -145,6 +302,222 @@ tnn_tensor_t *_tnn_conv(
 #define tnn_conv_5(input, dim_out, kernel_size, stride, padding)               \
 	_tnn_conv(input, dim_out, kernel_size, stride, padding)
 
+// conv where in and out channels are split into groups, each output channel
+// only reads the input channels of its group
+// - input dim is [..., height, width, in_channels]
+// - groups must divide both in_channels and dim_out
+// - weight is "group_conv" [kernel_size, kernel_size, in/groups, dim_out]
+tnn_tensor_t *_tnn_group_conv(
+    tnn_tensor_t *input,
+    size_t dim_out,
+    size_t groups,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding
+);
+#define tnn_group_conv(...) OPTARG_FUNC(tnn_group_conv, __VA_ARGS__)
+#define tnn_group_conv_3(input, dim_out, groups)                               \
+	_tnn_group_conv(input, dim_out, groups, 3, 1, 1)
+#define tnn_group_conv_4(input, dim_out, groups, kernel_size)                  \
+	_tnn_group_conv(input, dim_out, groups, kernel_size, 1, 1)
+#define tnn_group_conv_5(input, dim_out, groups, kernel_size, stride)          \
+	_tnn_group_conv(input, dim_out, groups, kernel_size, stride, 1)
+#define tnn_group_conv_6(input, dim_out, groups, kernel_size, stride, padding) \
+	_tnn_group_conv(input, dim_out, groups, kernel_size, stride, padding)
+
+// one filter per channel (groups == in_channels == out_channels)
+// - input dim is [..., height, width, channels]
+// - weight is "depthwise_conv" [kernel_size, kernel_size, 1, channels]
+tnn_tensor_t *_tnn_depthwise_conv(
+    tnn_tensor_t *input, size_t kernel_size, size_t stride, size_t padding
+);
+#define tnn_depthwise_conv(...) OPTARG_FUNC(tnn_depthwise_conv, __VA_ARGS__)
+#define tnn_depthwise_conv_1(input) _tnn_depthwise_conv(input, 3, 1, 1)
+#define tnn_depthwise_conv_2(input, kernel_size)                               \
+	_tnn_depthwise_conv(input, kernel_size, 1, 1)
+#define tnn_depthwise_conv_3(input, kernel_size, stride)                       \
+	_tnn_depthwise_conv(input, kernel_size, stride, 1)
+#define tnn_depthwise_conv_4(input, kernel_size, stride, padding)              \
+	_tnn_depthwise_conv(input, kernel_size, stride, padding)
+
+// max over each kernel_size x kernel_size window, per channel
+// - input dim is [..., height, width, channels]
+// - padding must be less than kernel_size, padded cells are never selected
+tnn_tensor_t *_tnn_maxpool(
+    tnn_tensor_t *input, size_t kernel_size, size_t stride, size_t padding
+);
+#define tnn_maxpool(...) OPTARG_FUNC(tnn_maxpool, __VA_ARGS__)
+#define tnn_maxpool_1(input) _tnn_maxpool(input, 2, 2, 0)
+#define tnn_maxpool_2(input, kernel_size)                                      \
+	_tnn_maxpool(input, kernel_size, kernel_size, 0)
+#define tnn_maxpool_3(input, kernel_size, stride)                              \
+	_tnn_maxpool(input, kernel_size, stride, 0)
+#define tnn_maxpool_4(input, kernel_size, stride, padding)                     \
+	_tnn_maxpool(input, kernel_size, stride, padding)
+
+// mean over each kernel_size x kernel_size window, per channel
+// - input dim is [..., height, width, channels]
+// - padding must be less than kernel_size, padded cells aren't counted
+tnn_tensor_t *_tnn_avgpool(
+    tnn_tensor_t *input, size_t kernel_size, size_t stride, size_t padding
+);
+#define tnn_avgpool(...) OPTARG_FUNC(tnn_avgpool, __VA_ARGS__)
+#define tnn_avgpool_1(input) _tnn_avgpool(input, 2, 2, 0)
+#define tnn_avgpool_2(input, kernel_size)                                      \
+	_tnn_avgpool(input, kernel_size, kernel_size, 0)
+#define tnn_avgpool_3(input, kernel_size, stride)                              \
+	_tnn_avgpool(input, kernel_size, stride, 0)
+#define tnn_avgpool_4(input, kernel_size, stride, padding)                     \
+	_tnn_avgpool(input, kernel_size, stride, padding)
+
+typedef struct {
+	size_t kernel_size;
+	size_t stride;
+	size_t padding;
+	float momentum;
+	bool test;
+	bool relu;
+	tnn_tensor_t *skip; // residual, added after bn, may be NULL
+} tnn_conv_bn_cfg_t;
+
+#define TNN_CONV_BN_CFG(...)                                                   \
+	((tnn_conv_bn_cfg_t){.kernel_size = 3,                                     \
+	                     .stride = 1,                                          \
+	                     .padding = 1,                                         \
+	                     .momentum = 0.9f,                                     \
+	                     .test = false,                                        \
+	                     .relu = true,                                         \
+	                     .skip = NULL,                                         \
+	                     __VA_ARGS__})
+
+// fused relu?(bn(conv(input)) + skip), only keeps the output and the
+// normalized conv output for backward
+// - same state keys as the unfused chain, checkpoints are interchangeable
+tnn_tensor_t *
+_tnn_conv_bn(tnn_tensor_t *input, size_t dim_out, tnn_conv_bn_cfg_t cfg);
+#define tnn_conv_bn(...) OPTARG_FUNC(tnn_conv_bn, __VA_ARGS__)
+#define tnn_conv_bn_2(input, dim_out)                                          \
+	_tnn_conv_bn(input, dim_out, TNN_CONV_BN_CFG())
+#define tnn_conv_bn_3(input, dim_out, cfg) _tnn_conv_bn(input, dim_out, cfg)
+
+///
+// BLOCKED LAYOUT
+// impl: src/ops/layout.c
+///
+
+// blocked tensors (NHWC8c) have their channels zero-padded to a multiple of
+// TNN_BLOCK_CHANNELS, so channel loops are whole vectors without tails
+// - tnn_conv(), tnn_bn(), tnn_relu(), tnn_add(), tnn_maxpool() and
+//   tnn_avgpool() take blocked input and give blocked output, other ops
+//   expect plain tensors
+// - convert at model boundaries, state keeps the plain channel count, so
+//   checkpoints don't depend on the layout
+#define TNN_BLOCK_CHANNELS 8
+
+// input dim is [..., channels], tracked in the output's channels field
+tnn_tensor_t *tnn_to_blocked(tnn_tensor_t *input);
+tnn_tensor_t *tnn_from_blocked(tnn_tensor_t *input);
+
+///
+// QUANTIZATION
+// impl: src/quant.c
+///
+
+// while enabled, tnn_proj() and tnn_conv() record the abs-max of their inputs
+// under "<op>/act", tnn_quantize() then uses it as a static activation range
+void tnn_calibrate(bool enabled);
+
+// converts "proj" and "conv" weights under scope to int8 with per-output
+// channel scales ("<op>/q8" and "<op>/scale"), dropping the float weights
+// - quantized ops are forward-only (inference)
+// - inputs without a calibrated range are quantized dynamically
+void _tnn_quantize(const char *scope);
+#define tnn_quantize(...) OPTARG_FUNC(tnn_quantize, __VA_ARGS__)
+#define tnn_quantize_0() _tnn_quantize(NULL)
+#define tnn_quantize_1(scope) _tnn_quantize(scope)
+
+///
+// BN FOLDING
+// impl: src/fold.c
+///
+
+// freezes every "<prefix>/bn" under scope into the "<prefix>/conv" it follows
+// (float or quantized): filters get scaled by 1/std per output channel and the
+// shift goes into a new "<prefix>/conv/bias"
+// - running stats are replaced by a "bn/folded" marker, tnn_bn() in test mode
+//   then returns its input unchanged
+// - folded layers are inference-only
+void _tnn_fold_bn(const char *scope);
+#define tnn_fold_bn(...) OPTARG_FUNC(tnn_fold_bn, __VA_ARGS__)
+#define tnn_fold_bn_0() _tnn_fold_bn(NULL)
+#define tnn_fold_bn_1(scope) _tnn_fold_bn(scope)
+
+///
+// WEIGHT PREPACKING
+// impl: src/prepack.c
+///
+
+// weights that kernels read in another order get packed copies kept on the
+// weight tensor, made on first use and redone after the weight is updated
+// (see: version), instead of repacking on every call
+// - for now: "conv" weights run on blocked input, see: tnn_to_blocked()
+// this packs every such weight under scope ahead of time, e.g. for a frozen
+// model served at small batch sizes where packing costs as much as the conv
+void _tnn_prepack(const char *scope);
+#define tnn_prepack(...) OPTARG_FUNC(tnn_prepack, __VA_ARGS__)
+#define tnn_prepack_0() _tnn_prepack(NULL)
+#define tnn_prepack_1(scope) _tnn_prepack(scope)
+
+///
+// DEFERRED ELEMENTWISE
+// impl: src/lazy.c
+///
+
+// while enabled, tnn_relu(), tnn_add() and tnn_bias() return tensors without
+// data that record the op, consecutive ones form an expression evaluated in a
+// single pass (and differentiated in a single fused backward) once a consumer
+// needs the data
+// - ops realize their inputs, other code must call tnn_realize() before
+//   reading data
+void tnn_defer_elementwise(bool enabled);
+
+// computes data of a deferred tensor, no-op for other tensors
+void tnn_realize(tnn_tensor_t *t);
+
+///
+// COMPACT ACTIVATIONS
+// impl: src/compact.c
+///
+
+// while enabled, ops save compact forms of what their backward needs instead
+// of reading the data of their inputs and outputs:
+// - tnn_relu() and the relu of tnn_conv_bn() keep a 1-bit mask
+// - bf16: tnn_bn() and tnn_conv_bn() keep the normalized output as bf16
+// tnn_backward() then releases the data of intermediate tensors that no
+// backward reads anymore (their data is NULL afterwards)
+void _tnn_compact_activations(bool enabled, bool bf16);
+#define tnn_compact_activations(...)                                           \
+	OPTARG_FUNC(tnn_compact_activations, __VA_ARGS__)
+#define tnn_compact_activations_1(enabled)                                     \
+	_tnn_compact_activations(enabled, false)
+#define tnn_compact_activations_2(enabled, bf16)                               \
+	_tnn_compact_activations(enabled, bf16)
+
+///
+// ACTIVATION OFFLOAD
+// impl: src/offload.c
+///
+
+// while enabled, activations that backward reads are moved to an unlinked
+// scratch file in scratch_dir once more than budget_bytes of them are resident
+// - oldest first, at scope exits (tnn_pop()) and when tnn_backward() starts
+// - written back by the kernel in the background, tnn_backward() reads them
+//   back a few nodes ahead of the pass
+// - data pointers of activations may change at these points
+// per context, tensors allocated while enabled must be freed on it
+// - NULL scratch_dir disables it
+void tnn_offload(const char *scratch_dir, size_t budget_bytes);
+
 ///
 // BACKPROP
 // impl: src/backprop.c
@@ -0,0 +1,240 @@
+#include <tnn/tnn.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./impl/backend.h"
+#include "./impl/conv.h"
+#include "./impl/malloc.h"
+
+// cache file, one tuned shape per line:
+//   cpu model \t backend \t batch h_in w_in c_in c_out k s p \t algo
+
+// timed runs per algorithm, the fastest one counts
+#define TUNE_RUNS 3
+#define SIGNATURE_LEN 8
+
+static const char *const _algo_names[TNN_CONV_NUM_ALGOS] = {
+    "direct",
+    "im2col",
+};
+
+typedef struct {
+	size_t signature[SIGNATURE_LEN];
+	tnn_conv_algo_t algo;
+} tune_entry_t;
+
+// process-wide, tuned shapes are shared by all contexts: lookups share the
+// lock, tuning and inserting hold it exclusively
+static pthread_rwlock_t _lock = PTHREAD_RWLOCK_INITIALIZER;
+static atomic_bool _enabled = false; // checked before taking the lock
+static char *_cache_path = NULL;     // NULL: disabled
+static char _cpu_model[256];
+static tune_entry_t *_entries = NULL;
+static size_t _num_entries = 0;
+static size_t _capacity = 0;
+
+static void _signature(const tnn_conv_shape_t *shape, size_t *signature) {
+	signature[0] = shape->batch;
+	signature[1] = shape->h_in;
+	signature[2] = shape->w_in;
+	signature[3] = shape->c_in;
+	signature[4] = shape->c_out;
+	signature[5] = shape->kernel_size;
+	signature[6] = shape->stride;
+	signature[7] = shape->padding;
+}
+
+static void _read_cpu_model(void) {
+	strcpy(_cpu_model, "unknown");
+
+	FILE *fp = fopen("/proc/cpuinfo", "r");
+	if (fp == NULL) {
+		return;
+	}
+	char line[512];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *value = strchr(line, ':');
+		if (strncmp(line, "model name", 10) != 0 || value == NULL) {
+			continue;
+		}
+		value += 2; // ": "
+		value[strcspn(value, "\t\n")] = '\0';
+		snprintf(_cpu_model, sizeof(_cpu_model), "%s", value);
+		break;
+	}
+	fclose(fp);
+}
+
+// false if out of memory, the shape is then just tuned again next time
+static bool _add_entry(const size_t *signature, tnn_conv_algo_t algo) {
+	if (_num_entries >= _capacity) {
+		size_t capacity = _capacity > 0 ? _capacity * 2 : 16;
+		tune_entry_t *entries =
+		    realloc(_entries, capacity * sizeof(tune_entry_t));
+		if (entries == NULL) {
+			return false;
+		}
+		_entries = entries;
+		_capacity = capacity;
+	}
+	tune_entry_t *entry = &_entries[_num_entries++];
+	memcpy(entry->signature, signature, SIGNATURE_LEN * sizeof(size_t));
+	entry->algo = algo;
+	return true;
+}
+
+static bool _find_entry(const size_t *signature, tnn_conv_algo_t *out_algo) {
+	size_t signature_bytes = SIGNATURE_LEN * sizeof(size_t);
+	for (size_t i = 0; i < _num_entries; i++) {
+		if (memcmp(_entries[i].signature, signature, signature_bytes) == 0) {
+			*out_algo = _entries[i].algo;
+			return true;
+		}
+	}
+	return false;
+}
+
+// entries of this cpu and backend, other lines are kept in the file
+static void _load_cache(void) {
+	FILE *fp = fopen(_cache_path, "r");
+	if (fp == NULL) {
+		return; // created on the first write
+	}
+
+	char line[1024];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		char *cpu = strtok(line, "\t");
+		char *backend = strtok(NULL, "\t");
+		char *dims = strtok(NULL, "\t");
+		char *algo = strtok(NULL, "\t\n");
+		if (algo == NULL || strcmp(cpu, _cpu_model) != 0 ||
+		    strcmp(backend, tnn_backend_name()) != 0) {
+			continue;
+		}
+
+		size_t signature[SIGNATURE_LEN];
+		char *cursor = dims;
+		for (size_t i = 0; i < SIGNATURE_LEN; i++) {
+			signature[i] = strtoull(cursor, &cursor, 10);
+		}
+		for (size_t i_algo = 0; i_algo < TNN_CONV_NUM_ALGOS; i_algo++) {
+			if (strcmp(algo, _algo_names[i_algo]) == 0) {
+				_add_entry(signature, (tnn_conv_algo_t)i_algo);
+			}
+		}
+	}
+	fclose(fp);
+}
+
+static void _append_cache(const size_t *signature, tnn_conv_algo_t algo) {
+	FILE *fp = fopen(_cache_path, "a");
+	if (fp == NULL) {
+		fprintf(
+		    stderr, "tnn_conv_autotune() failed to write: %s\n", _cache_path
+		);
+		return;
+	}
+	fprintf(fp, "%s\t%s\t", _cpu_model, tnn_backend_name());
+	for (size_t i = 0; i < SIGNATURE_LEN; i++) {
+		fprintf(fp, i > 0 ? " %zu" : "%zu", signature[i]);
+	}
+	fprintf(fp, "\t%s\n", _algo_names[algo]);
+	fclose(fp);
+}
+
+static double _now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static tnn_conv_algo_t _tune(
+    const tnn_conv_shape_t *shape, const float *input, const float *weight
+) {
+	size_t num_outputs =
+	    shape->batch * shape->h_out * shape->w_out * shape->c_out;
+	float *output = tnn_safe_malloc(num_outputs * sizeof(float));
+
+	tnn_conv_algo_t best = TNN_CONV_ALGO_DIRECT;
+	double best_time = 0.0;
+	for (size_t i_algo = 0; i_algo < TNN_CONV_NUM_ALGOS; i_algo++) {
+		tnn_conv_shape_t candidate = *shape;
+		candidate.algo = (tnn_conv_algo_t)i_algo;
+
+		double time = 0.0;
+		for (size_t run = 0; run < TUNE_RUNS; run++) {
+			double start = _now();
+			_tnn_conv_forward_parallel(&candidate, input, weight, output);
+			double elapsed = _now() - start;
+			time = run == 0 || elapsed < time ? elapsed : time;
+		}
+
+		if (i_algo == 0 || time < best_time) {
+			best = candidate.algo;
+			best_time = time;
+		}
+	}
+
+	free(output);
+	return best;
+}
+
+void tnn_conv_autotune(const char *cache_path) {
+	pthread_rwlock_wrlock(&_lock);
+
+	free(_cache_path);
+	free(_entries);
+	_cache_path = NULL;
+	_entries = NULL;
+	_num_entries = 0;
+	_capacity = 0;
+	if (cache_path != NULL) {
+		_cache_path = strdup(cache_path);
+		_read_cpu_model();
+		_load_cache();
+	}
+	atomic_store(&_enabled, cache_path != NULL);
+
+	pthread_rwlock_unlock(&_lock);
+}
+
+void _tnn_conv_autotune(
+    tnn_conv_shape_t *shape, const float *input, const float *weight
+) {
+	shape->algo = TNN_CONV_ALGO_DIRECT;
+	// 1x1 convs are a gemm whatever the algorithm
+	if (shape->kernel_size == 1 && shape->stride == 1 && shape->padding == 0) {
+		return;
+	}
+	// disabled by default, concurrent contexts never touch the lock then
+	if (!atomic_load(&_enabled)) {
+		return;
+	}
+
+	size_t signature[SIGNATURE_LEN];
+	_signature(shape, signature);
+	pthread_rwlock_rdlock(&_lock);
+	bool found = _find_entry(signature, &shape->algo);
+	pthread_rwlock_unlock(&_lock);
+	if (found) {
+		return;
+	}
+
+	// held while timing, so concurrent tuners don't skew each other
+	// - tuning may have been disabled or done by another thread meanwhile
+	pthread_rwlock_wrlock(&_lock);
+	if (_cache_path != NULL && !_find_entry(signature, &shape->algo)) {
+		shape->algo = _tune(shape, input, weight);
+		if (_add_entry(signature, shape->algo)) {
+			_append_cache(signature, shape->algo);
+		}
+	}
+	pthread_rwlock_unlock(&_lock);
+}
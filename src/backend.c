@@ -0,0 +1,96 @@
+#include <tnn/tnn.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./impl/backend.h"
+
+const tnn_backend_t *_tnn_backend = &_tnn_scalar_backend;
+
+#ifdef TNN_USE_BLAS
+static tnn_backend_t _blas_backend;
+static char _blas_name[32];
+#endif
+
+// best first
+static const tnn_backend_t *const _backends[] = {
+#ifdef TNN_BACKEND_X86
+    &_tnn_avx512vnni_backend,
+    &_tnn_avx512_backend,
+    &_tnn_avxvnni_backend,
+    &_tnn_avx2_backend,
+    &_tnn_sse4_backend,
+#endif
+    &_tnn_scalar_backend,
+};
+#define NUM_BACKENDS (sizeof(_backends) / sizeof(_backends[0]))
+
+// checked here, the backends themselves are built with their isa flags
+static bool _is_supported(const tnn_backend_t *backend) {
+#ifdef TNN_BACKEND_X86
+	__builtin_cpu_init();
+	if (backend == &_tnn_avx512vnni_backend) {
+		return _is_supported(&_tnn_avx512_backend) &&
+		       __builtin_cpu_supports("avx512vnni");
+	}
+	if (backend == &_tnn_avx512_backend) {
+		return __builtin_cpu_supports("avx512f") &&
+		       __builtin_cpu_supports("avx512bw") &&
+		       __builtin_cpu_supports("avx512vl");
+	}
+	if (backend == &_tnn_avxvnni_backend) {
+		return _is_supported(&_tnn_avx2_backend) &&
+		       __builtin_cpu_supports("avxvnni");
+	}
+	if (backend == &_tnn_avx2_backend) {
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	}
+	if (backend == &_tnn_sse4_backend) {
+		return __builtin_cpu_supports("sse4.1");
+	}
+#endif
+	return backend == &_tnn_scalar_backend;
+}
+
+static void _use(const tnn_backend_t *backend) {
+#ifdef TNN_USE_BLAS
+	// everything but sgemm stays with the picked backend
+	_blas_backend = *backend;
+	snprintf(_blas_name, sizeof(_blas_name), "%s+blas", backend->name);
+	_blas_backend.name = _blas_name;
+	_blas_backend.sgemm = _tnn_blas_sgemm;
+	backend = &_blas_backend;
+#endif
+	_tnn_backend = backend;
+}
+
+void _tnn_backend_init(void) {
+	const char *name = getenv("TNN_BACKEND");
+	const tnn_backend_t *best = NULL;
+
+	for (size_t i = 0; i < NUM_BACKENDS; i++) {
+		const tnn_backend_t *backend = _backends[i];
+		if (!_is_supported(backend)) {
+			continue;
+		}
+		if (name == NULL || strcmp(name, backend->name) == 0) {
+			_use(backend);
+			return;
+		}
+		if (best == NULL) {
+			best = backend;
+		}
+	}
+
+	fprintf(
+	    stderr, "TNN_BACKEND=%s is not available, using %s\n", name, best->name
+	);
+	_use(best);
+}
+
+const char *tnn_backend_name() {
+	return _tnn_backend->name;
+}
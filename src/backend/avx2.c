@@ -0,0 +1,9 @@
+// built with -mavx2 -mfma, see: CMakeLists.txt
+#ifdef TNN_BACKEND_X86
+
+#define TNN_KERNEL_AVX2
+#define TNN_KERNEL_NAME "avx2"
+#define TNN_KERNEL(name) _tnn_avx2_##name
+#include "../impl/kernels.h"
+
+#endif
@@ -0,0 +1,9 @@
+// built with -mavx512f -mavx512bw -mavx512vl, see: CMakeLists.txt
+#ifdef TNN_BACKEND_X86
+
+#define TNN_KERNEL_AVX512
+#define TNN_KERNEL_NAME "avx512"
+#define TNN_KERNEL(name) _tnn_avx512_##name
+#include "../impl/kernels.h"
+
+#endif
@@ -0,0 +1,11 @@
+// built with -mavx512f -mavx512bw -mavx512vl -mavx512vnni, see:
+// CMakeLists.txt
+#ifdef TNN_BACKEND_X86
+
+#define TNN_KERNEL_AVX512
+#define TNN_KERNEL_VNNI
+#define TNN_KERNEL_NAME "avx512vnni"
+#define TNN_KERNEL(name) _tnn_avx512vnni_##name
+#include "../impl/kernels.h"
+
+#endif
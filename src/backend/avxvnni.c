@@ -0,0 +1,10 @@
+// built with -mavx2 -mfma -mavxvnni, see: CMakeLists.txt
+#ifdef TNN_BACKEND_X86
+
+#define TNN_KERNEL_AVX2
+#define TNN_KERNEL_VNNI
+#define TNN_KERNEL_NAME "avxvnni"
+#define TNN_KERNEL(name) _tnn_avxvnni_##name
+#include "../impl/kernels.h"
+
+#endif
@@ -0,0 +1,42 @@
+// external cblas_sgemm (OpenBLAS, BLIS, MKL, ...), see: TNN_USE_BLAS in
+// CMakeLists.txt
+#ifdef TNN_USE_BLAS
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cblas.h>
+
+#include "../impl/backend.h"
+
+void _tnn_blas_sgemm(
+    const float *a,
+    const float *b,
+    float *c,
+    size_t m,
+    size_t k,
+    size_t n,
+    bool tpose_a,
+    bool tpose_b,
+    bool accum
+) {
+	// row-major, leading dims are the stored row lengths
+	cblas_sgemm(
+	    CblasRowMajor,
+	    tpose_a ? CblasTrans : CblasNoTrans,
+	    tpose_b ? CblasTrans : CblasNoTrans,
+	    (int)m,
+	    (int)n,
+	    (int)k,
+	    1.0f,
+	    a,
+	    tpose_a ? (int)m : (int)k,
+	    b,
+	    tpose_b ? (int)k : (int)n,
+	    accum ? 1.0f : 0.0f, // c isn't read with beta 0
+	    c,
+	    (int)n
+	);
+}
+
+#endif
@@ -0,0 +1,4 @@
+// plain C, the reference every other backend is checked against
+#define TNN_KERNEL_NAME "scalar"
+#define TNN_KERNEL(name) _tnn_scalar_##name
+#include "../impl/kernels.h"
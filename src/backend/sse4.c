@@ -0,0 +1,9 @@
+// built with -msse4.1, see: CMakeLists.txt
+#ifdef TNN_BACKEND_X86
+
+#define TNN_KERNEL_SSE4
+#define TNN_KERNEL_NAME "sse4"
+#define TNN_KERNEL(name) _tnn_sse4_##name
+#include "../impl/kernels.h"
+
+#endif
@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "./impl/compact.h"
 #include "./impl/key_str_utils.h"
+#include "./impl/lazy.h"
 #include "./impl/malloc.h"
+#include "./impl/offload.h"
 
 static void _tnn_toposort_helper(
     tnn_tensor_t *t,
@@ -102,6 +105,7 @@ void _tnn_zero_grad(const char *scope) {
 void tnn_backward(tnn_tensor_t *loss) {
 	assert(loss != NULL);
 	assert(tnn_size(loss) == 1 && "tnn_backward: loss must be scalar");
+	tnn_realize(loss);
 
 	// allocate initial loss grad wrt itself
 	if (loss->grad == NULL) {
@@ -112,14 +116,22 @@ void tnn_backward(tnn_tensor_t *loss) {
 	// pass in reverse topological order
 	size_t num_nodes;
 	tnn_tensor_t **nodes = _tnn_toposort(loss, &num_nodes);
+	_tnn_release_activations(nodes, num_nodes, loss);
+	_tnn_offload_enforce();
 	for (size_t i = num_nodes; i-- > 0;) {
 		tnn_tensor_t *node = nodes[i];
+		if (i >= TNN_OFFLOAD_LOOKAHEAD) {
+			_tnn_offload_prefetch(nodes[i - TNN_OFFLOAD_LOOKAHEAD]);
+		}
 		if (node->backward != NULL) {
 			// allocate parent grads if needed
 			for (size_t i_parent = 0; i_parent < node->num_parents;
 			     i_parent++) {
 				tnn_tensor_t *parent = node->parents[i_parent];
-				if (parent->requires_grad && parent->grad == NULL) {
+				// (unrealized parents are covered by node's fused backward,
+				// see: tnn_defer_elementwise())
+				if (parent->requires_grad && parent->grad == NULL &&
+				    !_tnn_is_deferred(parent)) {
 					size_t parent_size = tnn_size(parent);
 					parent->grad = calloc(parent_size, sizeof(float));
 				}
@@ -0,0 +1,826 @@
+#include <tnn/tnn.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "./impl/key_str_utils.h"
+#include "./impl/malloc.h"
+#include "./impl/mapping.h"
+#include "./impl/state.h"
+
+// format v3:
+//   u32 magic, u32 version, u32 num_entries, u32 alignment
+//   u32 base_len, base (path of the checkpoint this one is a delta of)
+//   index: num_entries * {u32 key_len, key, u32 num_dims, u32 dims[],
+//                         u64 offset, u64 hash}
+//   payloads: raw floats at the indexed (aligned) byte offsets
+// format v2:
+//   same as v3 without base and hashes
+// format v1 (legacy, no header):
+//   sequence of {u32 key_len, key, u32 num_dims, u32 dims[], floats}
+#define TNN_CKPT_MAGIC 0x434e4e54u // "TNNC"
+#define TNN_CKPT_VERSION 3
+#define TNN_CKPT_ALIGN 64
+#define TNN_CKPT_MAX_DIMS 100
+#define TNN_CKPT_MAX_CHAIN 64
+
+typedef struct {
+	const char *key; // relative to the saved scope
+	tnn_tensor_t *t;
+	uint64_t offset;
+	uint64_t hash;
+} ckpt_item_t;
+
+static size_t _align_up(size_t x, size_t alignment) {
+	return (x + alignment - 1) / alignment * alignment;
+}
+
+// content hash used to detect changed tensors, 0 is reserved for "unknown"
+static uint64_t _hash_payload(const float *data, size_t size) {
+	const uint8_t *bytes = (const uint8_t *)data;
+	size_t num_bytes = size * sizeof(float);
+
+	uint64_t hash = 0x9e3779b97f4a7c15ull ^ num_bytes;
+	size_t i = 0;
+	for (; i + 8 <= num_bytes; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(uint64_t));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+	for (; i < num_bytes; i++) {
+		hash = (hash ^ bytes[i]) * 0xc4ceb9fe1a85ec53ull;
+	}
+	hash ^= hash >> 29;
+	return hash != 0 ? hash : 1;
+}
+
+static ckpt_item_t *_collect_items(const char *scope, size_t *out_count) {
+	size_t count = 0;
+	size_t capacity = 64;
+	ckpt_item_t *items = tnn_safe_malloc(capacity * sizeof(ckpt_item_t));
+
+	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
+		tnn_state_entry_t *entry = tnn_state.state_dict[i];
+		while (entry != NULL) {
+			// skip if not under scope
+			if (_tnn_key_in_scope(entry->key, scope)) {
+				if (count >= capacity) {
+					capacity *= 2;
+					items = realloc(items, capacity * sizeof(ckpt_item_t));
+				}
+				items[count].key = _tnn_relative_key(entry->key, scope);
+				items[count].t = entry->param;
+				items[count].offset = 0;
+				items[count].hash = 0;
+				count++;
+			}
+			entry = entry->next;
+		}
+	}
+
+	*out_count = count;
+	return items;
+}
+
+// lays out payloads after the index, returns the index size
+static size_t _layout_items(
+    ckpt_item_t *items,
+    size_t num_items,
+    const char *base,
+    size_t *out_file_size
+) {
+	size_t index_size = 5 * sizeof(uint32_t) + strlen(base);
+	for (size_t i = 0; i < num_items; i++) {
+		size_t num_dims = items[i].t->num_dims;
+		index_size += sizeof(uint32_t) + strlen(items[i].key);
+		index_size += sizeof(uint32_t) + num_dims * sizeof(uint32_t);
+		index_size += 2 * sizeof(uint64_t);
+	}
+
+	size_t offset = _align_up(index_size, TNN_CKPT_ALIGN);
+	for (size_t i = 0; i < num_items; i++) {
+		items[i].offset = offset;
+		offset += tnn_size(items[i].t) * sizeof(float);
+		offset = _align_up(offset, TNN_CKPT_ALIGN);
+	}
+
+	*out_file_size = offset;
+	return index_size;
+}
+
+static void _put_bytes(char **cursor, const void *src, size_t n) {
+	memcpy(*cursor, src, n);
+	*cursor += n;
+}
+
+// serializes header and index into out (index size bytes)
+// - out_hash_pos: optional, receives the position of each hash field
+static void _write_index(
+    char *out,
+    ckpt_item_t *items,
+    size_t num_items,
+    const char *base,
+    size_t *out_hash_pos
+) {
+	char *cursor = out;
+
+	uint32_t header[4] = {
+	    TNN_CKPT_MAGIC, TNN_CKPT_VERSION, (uint32_t)num_items, TNN_CKPT_ALIGN
+	};
+	_put_bytes(&cursor, header, sizeof(header));
+
+	uint32_t base_len = (uint32_t)strlen(base);
+	_put_bytes(&cursor, &base_len, sizeof(uint32_t));
+	_put_bytes(&cursor, base, base_len);
+
+	for (size_t i = 0; i < num_items; i++) {
+		tnn_tensor_t *t = items[i].t;
+
+		uint32_t key_len = (uint32_t)strlen(items[i].key);
+		_put_bytes(&cursor, &key_len, sizeof(uint32_t));
+		_put_bytes(&cursor, items[i].key, key_len);
+
+		uint32_t num_dims = (uint32_t)t->num_dims;
+		_put_bytes(&cursor, &num_dims, sizeof(uint32_t));
+		for (size_t i_dim = 0; i_dim < t->num_dims; i_dim++) {
+			uint32_t dim_u32 = (uint32_t)t->dims[i_dim];
+			_put_bytes(&cursor, &dim_u32, sizeof(uint32_t));
+		}
+
+		_put_bytes(&cursor, &items[i].offset, sizeof(uint64_t));
+		if (out_hash_pos != NULL) {
+			out_hash_pos[i] = (size_t)(cursor - out);
+		}
+		_put_bytes(&cursor, &items[i].hash, sizeof(uint64_t));
+	}
+}
+
+// writes items (with hashes filled in) as a checkpoint file
+static void _write_file(
+    const char *filename,
+    ckpt_item_t *items,
+    size_t num_items,
+    const char *base,
+    const char *caller
+) {
+	FILE *fp = fopen(filename, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "%s failed to open: %s\n", caller, filename);
+		return;
+	}
+
+	size_t file_size;
+	size_t index_size = _layout_items(items, num_items, base, &file_size);
+
+	// write header and index
+	char *index = tnn_safe_malloc(index_size);
+	_write_index(index, items, num_items, base, NULL);
+	fwrite(index, 1, index_size, fp);
+	free(index);
+
+	// write aligned payloads
+	static const char zeros[TNN_CKPT_ALIGN] = {0};
+	size_t written = index_size;
+	for (size_t i = 0; i < num_items; i++) {
+		fwrite(zeros, 1, items[i].offset - written, fp);
+		size_t total_size = tnn_size(items[i].t);
+		fwrite(items[i].t->data, sizeof(float), total_size, fp);
+		written = items[i].offset + total_size * sizeof(float);
+	}
+
+	fclose(fp);
+}
+
+void tnn_save(const char *filename) {
+	// lazily loaded tensors are saved too
+	_tnn_materialize_scope(tnn_state.active_scope);
+
+	size_t num_items;
+	ckpt_item_t *items = _collect_items(tnn_state.active_scope, &num_items);
+	for (size_t i = 0; i < num_items; i++) {
+		items[i].hash = _hash_payload(items[i].t->data, tnn_size(items[i].t));
+	}
+
+	_write_file(filename, items, num_items, "", "tnn_save()");
+
+	free(items);
+}
+
+struct tnn_save_job {
+	pthread_t thread;
+	bool joinable;
+	char *filename;
+	char *tmp_filename;
+	char *image; // staged copy of the whole file
+	size_t image_size;
+	size_t num_items;
+	size_t *hash_pos;      // where to patch in each hash
+	uint64_t *payload_pos; // [offset, size in floats] of each payload
+	atomic_bool done;
+	int result;
+};
+
+static int _write_all(int fd, const char *buf, size_t size) {
+	while (size > 0) {
+		ssize_t n = write(fd, buf, size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		buf += n;
+		size -= (size_t)n;
+	}
+	return 0;
+}
+
+static void *_save_job_main(void *arg) {
+	tnn_save_job_t *job = (tnn_save_job_t *)arg;
+
+	// hash the snapshot off the training thread
+	for (size_t i = 0; i < job->num_items; i++) {
+		const float *payload =
+		    (const float *)(job->image + job->payload_pos[2 * i]);
+		uint64_t hash = _hash_payload(payload, job->payload_pos[2 * i + 1]);
+		memcpy(job->image + job->hash_pos[i], &hash, sizeof(uint64_t));
+	}
+
+	// write to a sibling file, then atomically replace the target
+	job->result = -1;
+	int fd = open(job->tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0) {
+		bool ok = _write_all(fd, job->image, job->image_size) == 0 &&
+		          fsync(fd) == 0;
+		ok = close(fd) == 0 && ok;
+		if (ok && rename(job->tmp_filename, job->filename) == 0) {
+			job->result = 0;
+		} else {
+			unlink(job->tmp_filename);
+		}
+	}
+	if (job->result != 0) {
+		fprintf(
+		    stderr, "tnn_save_async() failed to write: %s\n", job->filename
+		);
+	}
+
+	// staging copy is no longer needed
+	free(job->image);
+	job->image = NULL;
+
+	atomic_store(&job->done, true);
+	return NULL;
+}
+
+tnn_save_job_t *tnn_save_async(const char *filename) {
+	// lazily loaded tensors are saved too
+	_tnn_materialize_scope(tnn_state.active_scope);
+
+	size_t num_items, file_size;
+	ckpt_item_t *items = _collect_items(tnn_state.active_scope, &num_items);
+	size_t index_size = _layout_items(items, num_items, "", &file_size);
+
+	tnn_save_job_t *job = tnn_safe_malloc(sizeof(tnn_save_job_t));
+	job->num_items = num_items;
+	job->hash_pos = tnn_safe_malloc(num_items * sizeof(size_t));
+	job->payload_pos = tnn_safe_malloc(num_items * 2 * sizeof(uint64_t));
+	job->filename = strdup(filename);
+	job->tmp_filename = tnn_safe_malloc(strlen(filename) + 5);
+	sprintf(job->tmp_filename, "%s.tmp", filename);
+	job->result = -1;
+	job->joinable = false;
+	atomic_init(&job->done, false);
+
+	// consistent snapshot: copy everything into one staging image, training
+	// may continue as soon as this returns
+	// - as large as the checkpoint, a failure is reported by tnn_save_wait()
+	char *image = malloc(file_size);
+	if (image == NULL) {
+		fprintf(
+		    stderr,
+		    "tnn_save_async() failed to allocate %zu bytes for: %s\n",
+		    file_size,
+		    filename
+		);
+		free(items);
+		atomic_store(&job->done, true);
+		return job;
+	}
+
+	_write_index(image, items, num_items, "", job->hash_pos);
+	size_t gap_begin = index_size;
+	for (size_t i = 0; i < num_items; i++) {
+		// alignment gaps are zeroed, payloads are copied over
+		memset(image + gap_begin, 0, items[i].offset - gap_begin);
+		size_t total_size = tnn_size(items[i].t);
+		memcpy(
+		    image + items[i].offset,
+		    items[i].t->data,
+		    total_size * sizeof(float)
+		);
+		job->payload_pos[2 * i] = items[i].offset;
+		job->payload_pos[2 * i + 1] = total_size;
+		gap_begin = items[i].offset + total_size * sizeof(float);
+	}
+	memset(image + gap_begin, 0, file_size - gap_begin);
+	free(items);
+
+	job->image = image;
+	job->image_size = file_size;
+
+	job->joinable =
+	    pthread_create(&job->thread, NULL, _save_job_main, job) == 0;
+	if (!job->joinable) {
+		// no thread, write on the caller
+		_save_job_main(job);
+	}
+
+	return job;
+}
+
+bool tnn_save_poll(tnn_save_job_t *job) {
+	return atomic_load(&job->done);
+}
+
+int tnn_save_wait(tnn_save_job_t *job) {
+	if (job->joinable) {
+		pthread_join(job->thread, NULL);
+	}
+
+	int result = job->result;
+	free(job->hash_pos);
+	free(job->payload_pos);
+	free(job->filename);
+	free(job->tmp_filename);
+	free(job);
+	return result;
+}
+
+static void _load_v1(FILE *fp) {
+	while (true) {
+		// read key
+		uint32_t key_len;
+		if (fread(&key_len, sizeof(uint32_t), 1, fp) != 1) {
+			break; // eof
+		}
+		char *relative_key = tnn_safe_malloc(key_len + 1);
+		fread(relative_key, sizeof(char), key_len, fp);
+		relative_key[key_len] = '\0';
+
+		// read dims
+		uint32_t num_dims;
+		fread(&num_dims, sizeof(uint32_t), 1, fp);
+		size_t *dims = tnn_safe_malloc(num_dims * sizeof(size_t));
+		for (size_t i_dim = 0; i_dim < num_dims; i_dim++) {
+			uint32_t dim_u32;
+			fread(&dim_u32, sizeof(uint32_t), 1, fp);
+			dims[i_dim] = dim_u32;
+		}
+
+		size_t total_size = 1;
+		for (size_t i_dim = 0; i_dim < num_dims; i_dim++) {
+			total_size *= dims[i_dim];
+		}
+
+		tnn_tensor_t *t = tnn_alloc(dims, num_dims);
+		t->is_state = true;
+		t->requires_grad = true;
+
+		fread(t->data, sizeof(float), total_size, fp);
+
+		free(dims);
+
+		tnn_set_state(relative_key, t);
+
+		free(relative_key);
+	}
+}
+
+// bounds-checked reads from the mapped index
+static bool
+_read_bytes(const char **cursor, const char *end, void *out, size_t n) {
+	if ((size_t)(end - *cursor) < n) {
+		return false;
+	}
+	memcpy(out, *cursor, n);
+	*cursor += n;
+	return true;
+}
+
+typedef struct {
+	char *key;
+	size_t *dims;
+	size_t num_dims;
+	uint64_t offset;
+	uint64_t hash; // 0 if unknown (v2)
+} ckpt_entry_t;
+
+typedef struct {
+	tnn_mapping_t *mapping;
+	char *base; // resolved path of the base checkpoint, NULL if none
+	ckpt_entry_t *entries;
+	size_t num_entries;
+} ckpt_index_t;
+
+static void _close_index(ckpt_index_t *index) {
+	for (size_t i = 0; i < index->num_entries; i++) {
+		free(index->entries[i].key);
+		free(index->entries[i].dims);
+	}
+	free(index->entries);
+	free(index->base);
+	_tnn_mapping_release(index->mapping);
+}
+
+// relative base paths are stored relative to the delta's directory
+static char *_resolve_base(const char *filename, const char *base) {
+	const char *last_slash = strrchr(filename, '/');
+	if (base[0] == '/' || last_slash == NULL) {
+		return strdup(base);
+	}
+
+	size_t dir_len = (size_t)(last_slash - filename) + 1;
+	char *resolved = tnn_safe_malloc(dir_len + strlen(base) + 1);
+	memcpy(resolved, filename, dir_len);
+	strcpy(resolved + dir_len, base);
+	return resolved;
+}
+
+// maps a v2/v3 file and parses its index, payloads stay untouched
+static bool
+_open_index(const char *filename, const char *caller, ckpt_index_t *index) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s failed to open: %s\n", caller, filename);
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		fprintf(stderr, "%s failed to stat: %s\n", caller, filename);
+		close(fd);
+		return false;
+	}
+	size_t file_size = (size_t)st.st_size;
+
+	// private mapping: pages are shared with the page cache until written
+	void *addr =
+	    mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		fprintf(stderr, "%s failed to map: %s\n", caller, filename);
+		return false;
+	}
+
+	index->mapping = tnn_safe_malloc(sizeof(tnn_mapping_t));
+	index->mapping->addr = addr;
+	index->mapping->len = file_size;
+	index->mapping->num_refs = 1; // held by the index
+	index->mapping->scratch = NULL;
+	index->base = NULL;
+	index->entries = NULL;
+	index->num_entries = 0;
+
+	const char *cursor = (const char *)addr;
+	const char *end = cursor + file_size;
+
+	uint32_t header[4];
+	if (!_read_bytes(&cursor, end, header, sizeof(header)) ||
+	    header[0] != TNN_CKPT_MAGIC || header[1] < 2 ||
+	    header[1] > TNN_CKPT_VERSION) {
+		fprintf(stderr, "%s unsupported version: %s\n", caller, filename);
+		_close_index(index);
+		return false;
+	}
+	uint32_t version = header[1];
+	uint32_t num_entries = header[2];
+
+	char key[TNN_STATE_KEY_MAX_LEN];
+	bool ok = true;
+
+	if (version >= 3) {
+		uint32_t base_len;
+		ok = _read_bytes(&cursor, end, &base_len, sizeof(uint32_t)) &&
+		     base_len < sizeof(key) && _read_bytes(&cursor, end, key, base_len);
+		if (ok && base_len > 0) {
+			key[base_len] = '\0';
+			index->base = _resolve_base(filename, key);
+		}
+	}
+
+	index->entries = tnn_safe_malloc(num_entries * sizeof(ckpt_entry_t));
+	for (uint32_t i = 0; ok && i < num_entries; i++) {
+		uint32_t key_len, num_dims;
+		uint64_t offset, hash = 0;
+
+		ok = _read_bytes(&cursor, end, &key_len, sizeof(uint32_t)) &&
+		     key_len < sizeof(key) &&
+		     _read_bytes(&cursor, end, key, key_len) &&
+		     _read_bytes(&cursor, end, &num_dims, sizeof(uint32_t)) &&
+		     num_dims <= TNN_CKPT_MAX_DIMS;
+		if (!ok) {
+			break;
+		}
+
+		size_t *dims = tnn_safe_malloc(num_dims * sizeof(size_t));
+		size_t total_size = 1;
+		for (uint32_t i_dim = 0; ok && i_dim < num_dims; i_dim++) {
+			uint32_t dim_u32;
+			if (!_read_bytes(&cursor, end, &dim_u32, sizeof(uint32_t))) {
+				ok = false;
+				break;
+			}
+			// a wrapped size would pass the bounds check below
+			if (dim_u32 != 0 && total_size > SIZE_MAX / dim_u32) {
+				ok = false;
+				break;
+			}
+			dims[i_dim] = dim_u32;
+			total_size *= dim_u32;
+		}
+		ok = ok && _read_bytes(&cursor, end, &offset, sizeof(uint64_t)) &&
+		     (version < 3 ||
+		      _read_bytes(&cursor, end, &hash, sizeof(uint64_t))) &&
+		     offset % sizeof(float) == 0 && offset <= file_size &&
+		     total_size <= (file_size - offset) / sizeof(float);
+		if (!ok) {
+			free(dims);
+			break;
+		}
+
+		ckpt_entry_t *entry = &index->entries[index->num_entries++];
+		entry->key = tnn_safe_malloc(key_len + 1);
+		memcpy(entry->key, key, key_len);
+		entry->key[key_len] = '\0';
+		entry->dims = dims;
+		entry->num_dims = num_dims;
+		entry->offset = offset;
+		entry->hash = hash;
+	}
+
+	if (!ok) {
+		fprintf(stderr, "%s corrupt index: %s\n", caller, filename);
+		_close_index(index);
+		return false;
+	}
+
+	return true;
+}
+
+// newer load wins over anything already in the state dict
+static void _replace_state(const char *key, tnn_tensor_t *t) {
+	tnn_tensor_t *old = _tnn_take_state(key);
+	if (old != NULL) {
+		tnn_free(old);
+	}
+	tnn_set_state(key, t);
+}
+
+static void _load_v2(const char *filename, bool lazy, size_t depth) {
+	ckpt_index_t index;
+	if (!_open_index(filename, "tnn_load()", &index)) {
+		return;
+	}
+
+	// resolve the delta chain oldest first
+	if (index.base != NULL) {
+		if (depth < TNN_CKPT_MAX_CHAIN) {
+			_load_v2(index.base, lazy, depth + 1);
+		} else {
+			fprintf(
+			    stderr, "tnn_load() delta chain too long: %s\n", filename
+			);
+		}
+	}
+
+	for (size_t i = 0; i < index.num_entries; i++) {
+		ckpt_entry_t *entry = &index.entries[i];
+		if (lazy) {
+			_tnn_defer_state(
+			    entry->key,
+			    entry->dims,
+			    entry->num_dims,
+			    index.mapping,
+			    entry->offset
+			);
+		} else {
+			tnn_tensor_t *t = _tnn_alloc_mapped(
+			    entry->dims, entry->num_dims, index.mapping, entry->offset
+			);
+			t->is_state = true;
+			t->requires_grad = true;
+			_replace_state(entry->key, t);
+		}
+	}
+
+	_close_index(&index);
+}
+
+void _tnn_load(const char *filename, bool lazy) {
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "tnn_load() failed to open: %s\n", filename);
+		return;
+	}
+
+	// legacy files start with the first key length instead of the magic
+	uint32_t magic = 0;
+	size_t num_read = fread(&magic, sizeof(uint32_t), 1, fp);
+
+	if (num_read == 1 && magic == TNN_CKPT_MAGIC) {
+		fclose(fp);
+		_load_v2(filename, lazy, 0);
+	} else {
+		// no index to defer on
+		rewind(fp);
+		_load_v1(fp);
+		fclose(fp);
+	}
+}
+
+typedef struct {
+	char *key;
+	size_t *dims;
+	size_t num_dims;
+	uint64_t hash;
+	size_t depth; // position in the delta chain, 0 is the newest file
+} ckpt_known_t;
+
+static int _compare_known(const void *a, const void *b) {
+	const ckpt_known_t *known_a = (const ckpt_known_t *)a;
+	const ckpt_known_t *known_b = (const ckpt_known_t *)b;
+	int cmp = strcmp(known_a->key, known_b->key);
+	if (cmp != 0) {
+		return cmp;
+	}
+	if (known_a->depth != known_b->depth) {
+		return known_a->depth < known_b->depth ? -1 : 1;
+	}
+	return 0;
+}
+
+static int _compare_known_key(const void *key, const void *known) {
+	return strcmp((const char *)key, ((const ckpt_known_t *)known)->key);
+}
+
+static void _free_known(ckpt_known_t *known) {
+	free(known->key);
+	free(known->dims);
+}
+
+// latest hash and shape of every key along the chain starting at filename
+static ckpt_known_t *_resolve_chain(const char *filename, size_t *out_count) {
+	size_t num_known = 0;
+	ckpt_known_t *known = NULL;
+
+	char *chain_filename = strdup(filename);
+	for (size_t depth = 0; chain_filename != NULL; depth++) {
+		ckpt_index_t index;
+		if (depth >= TNN_CKPT_MAX_CHAIN ||
+		    !_open_index(chain_filename, "tnn_save_delta()", &index)) {
+			free(chain_filename);
+			break;
+		}
+
+		known = realloc(
+		    known, (num_known + index.num_entries) * sizeof(ckpt_known_t)
+		);
+		for (size_t i = 0; i < index.num_entries; i++) {
+			ckpt_entry_t *entry = &index.entries[i];
+			known[num_known].key = entry->key;
+			known[num_known].dims = entry->dims;
+			known[num_known].num_dims = entry->num_dims;
+			known[num_known].hash = entry->hash;
+			known[num_known].depth = depth;
+			num_known++;
+
+			// moved into known
+			entry->key = NULL;
+			entry->dims = NULL;
+		}
+
+		free(chain_filename);
+		chain_filename = index.base != NULL ? strdup(index.base) : NULL;
+		_close_index(&index);
+	}
+
+	// a newer file in the chain shadows older ones
+	qsort(known, num_known, sizeof(ckpt_known_t), _compare_known);
+	size_t num_unique = 0;
+	for (size_t i = 0; i < num_known; i++) {
+		if (num_unique > 0 &&
+		    strcmp(known[num_unique - 1].key, known[i].key) == 0) {
+			_free_known(&known[i]);
+		} else {
+			known[num_unique++] = known[i];
+		}
+	}
+
+	*out_count = num_unique;
+	return known;
+}
+
+void tnn_save_delta(const char *filename, const char *base_filename) {
+	// lazily loaded tensors are compared too
+	_tnn_materialize_scope(tnn_state.active_scope);
+
+	size_t num_known;
+	ckpt_known_t *known = _resolve_chain(base_filename, &num_known);
+
+	// keep only new or modified tensors
+	size_t num_items;
+	ckpt_item_t *items = _collect_items(tnn_state.active_scope, &num_items);
+	size_t num_changed = 0;
+	for (size_t i = 0; i < num_items; i++) {
+		tnn_tensor_t *t = items[i].t;
+		items[i].hash = _hash_payload(t->data, tnn_size(t));
+
+		ckpt_known_t *base_entry = bsearch(
+		    items[i].key,
+		    known,
+		    num_known,
+		    sizeof(ckpt_known_t),
+		    _compare_known_key
+		);
+		bool unchanged = base_entry != NULL &&
+		                 base_entry->hash == items[i].hash &&
+		                 base_entry->num_dims == t->num_dims &&
+		                 memcmp(
+		                     base_entry->dims,
+		                     t->dims,
+		                     t->num_dims * sizeof(size_t)
+		                 ) == 0;
+		if (!unchanged) {
+			items[num_changed++] = items[i];
+		}
+	}
+
+	for (size_t i = 0; i < num_known; i++) {
+		_free_known(&known[i]);
+	}
+	free(known);
+
+	// store the base relative to the delta when they share a directory,
+	// absolute otherwise
+	const char *base_slash = strrchr(base_filename, '/');
+	const char *delta_slash = strrchr(filename, '/');
+	size_t base_dir_len = base_slash ? (size_t)(base_slash - base_filename) : 0;
+	size_t delta_dir_len = delta_slash ? (size_t)(delta_slash - filename) : 0;
+
+	char *base;
+	if (base_dir_len == delta_dir_len &&
+	    strncmp(base_filename, filename, base_dir_len) == 0) {
+		base = strdup(base_slash ? base_slash + 1 : base_filename);
+	} else {
+		base = realpath(base_filename, NULL);
+		if (base == NULL) {
+			base = strdup(base_filename);
+		}
+	}
+
+	_write_file(filename, items, num_changed, base, "tnn_save_delta()");
+
+	free(base);
+	free(items);
+}
+
+void tnn_prefetch(const char *scope) {
+	char full_scope[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_scope, tnn_state.active_scope, scope);
+
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
+		tnn_pending_entry_t *pending = tnn_state.pending_dict[i];
+		while (pending != NULL) {
+			if (_tnn_key_in_scope(pending->key, full_scope)) {
+				size_t total_size = 1;
+				for (size_t i_dim = 0; i_dim < pending->num_dims; i_dim++) {
+					total_size *= pending->dims[i_dim];
+				}
+
+				// start read-ahead without materializing
+				size_t begin = pending->offset / page_size * page_size;
+				size_t end = pending->offset + total_size * sizeof(float);
+				madvise(
+				    (char *)pending->mapping->addr + begin,
+				    end - begin,
+				    MADV_WILLNEED
+				);
+			}
+			pending = pending->next;
+		}
+	}
+}
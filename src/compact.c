@@ -0,0 +1,75 @@
+#include <tnn/tnn.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./impl/compact.h"
+#include "./impl/malloc.h"
+#include "./impl/state.h"
+
+void _tnn_compact_activations(bool enabled, bool bf16) {
+	tnn_state.compacting = enabled;
+	tnn_state.compact_bf16 = enabled && bf16;
+}
+
+// open addressing slot of node in a table of capacity (power of two)
+static size_t _slot(tnn_tensor_t **keys, size_t capacity, tnn_tensor_t *node) {
+	size_t slot = ((uintptr_t)node >> 4) * 0x9E3779B97F4A7C15u;
+	for (slot &= capacity - 1; keys[slot] != NULL && keys[slot] != node;
+	     slot = (slot + 1) & (capacity - 1)) {
+	}
+	return slot;
+}
+
+void _tnn_release_activations(
+    tnn_tensor_t **nodes, size_t num_nodes, tnn_tensor_t *loss
+) {
+	size_t capacity = 16;
+	while (capacity < 2 * num_nodes) {
+		capacity <<= 1;
+	}
+	tnn_tensor_t **keys = tnn_safe_malloc(capacity * sizeof(tnn_tensor_t *));
+	size_t *counts = tnn_safe_malloc(2 * capacity * sizeof(size_t));
+	memset(keys, 0, capacity * sizeof(tnn_tensor_t *));
+	memset(counts, 0, 2 * capacity * sizeof(size_t));
+
+	// per parent: children refs in the graph and those not reading data
+	for (size_t i = 0; i < num_nodes; i++) {
+		size_t slot = _slot(keys, capacity, nodes[i]);
+		keys[slot] = nodes[i];
+	}
+	for (size_t i = 0; i < num_nodes; i++) {
+		tnn_tensor_t *child = nodes[i];
+		for (size_t k = 0; k < child->num_parents; k++) {
+			size_t slot = _slot(keys, capacity, child->parents[k]);
+			if (keys[slot] == NULL) {
+				continue;
+			}
+			counts[2 * slot]++;
+			counts[2 * slot + 1] += (child->compact_parents >> k) & 1;
+		}
+	}
+
+	for (size_t i = 0; i < num_nodes; i++) {
+		tnn_tensor_t *node = nodes[i];
+		if (!node->compact || node == loss || node->is_state ||
+		    node->num_parents == 0 || node->mapping != NULL ||
+		    node->data == NULL) {
+			continue;
+		}
+
+		// every child must be in the graph and opted out of reading data
+		size_t slot = _slot(keys, capacity, node);
+		if (counts[2 * slot] == node->num_children &&
+		    counts[2 * slot + 1] == node->num_children) {
+			free(node->data);
+			node->data = NULL;
+		}
+	}
+
+	free(keys);
+	free(counts);
+}
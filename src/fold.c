@@ -0,0 +1,125 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./impl/key_str_utils.h"
+#include "./impl/malloc.h"
+#include "./impl/state.h"
+
+// folds "<prefix>/bn" into "<prefix>/conv" (float or int8), false if there's
+// no conv to fold into
+static bool _fold_bn(const char *prefix) {
+	char key[TNN_STATE_KEY_MAX_LEN];
+
+	_tnn_cat_keys(key, prefix, "conv");
+	tnn_tensor_t *weight = tnn_get_state(key);
+	_tnn_cat_keys(key, prefix, "conv/scale");
+	tnn_tensor_t *scale = tnn_get_state(key); // see: tnn_quantize()
+	if (weight == NULL && scale == NULL) {
+		return false;
+	}
+
+	_tnn_cat_keys(key, prefix, "bn/mean");
+	tnn_tensor_t *running_mean = tnn_get_state(key);
+	_tnn_cat_keys(key, prefix, "bn/var");
+	tnn_tensor_t *running_var = tnn_get_state(key);
+	assert(running_mean != NULL && running_var != NULL);
+
+	size_t C = tnn_size(running_mean);
+	assert(tnn_size(running_var) == C);
+
+	// y = (conv(x) + b - mean) / std
+	//   = conv(x) * (1 / std) + (b - mean) / std
+	// where the per-output-channel 1 / std goes into the filters
+	size_t bias_dims[1] = {C};
+	bool bias_created = false;
+	_tnn_cat_keys(key, prefix, "conv/bias");
+	tnn_tensor_t *bias =
+	    tnn_alloc_or_get_state(bias_dims, 1, key, &bias_created);
+	if (bias_created) {
+		tnn_init_fill(bias, 0);
+	}
+
+	for (size_t c = 0; c < C; c++) {
+		float std_inv = 1.0f / sqrtf(running_var->data[c] + 1e-5f);
+
+		if (weight != NULL) {
+			// [out_channels, kernel_size, kernel_size, in_channels]
+			assert(weight->dims[0] == C);
+			size_t filter_size = tnn_size(weight) / C;
+			float *filter = weight->data + c * filter_size;
+			for (size_t i = 0; i < filter_size; i++) {
+				filter[i] *= std_inv;
+			}
+		} else {
+			scale->data[c] *= std_inv;
+		}
+
+		bias->data[c] = (bias->data[c] - running_mean->data[c]) * std_inv;
+	}
+	if (weight != NULL) {
+		weight->version++;
+	}
+
+	// running stats are meaningless now, leave a marker for tnn_bn()
+	_tnn_cat_keys(key, prefix, "bn");
+	tnn_drop_state(key);
+	size_t folded_dims[1] = {1};
+	_tnn_cat_keys(key, prefix, "bn/folded");
+	tnn_tensor_t *folded = tnn_alloc_or_get_state(folded_dims, 1, key, NULL);
+	folded->data[0] = 1.0f;
+
+	return true;
+}
+
+void _tnn_fold_bn(const char *scope) {
+	char full_scope[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_scope, tnn_state.active_scope, scope);
+	_tnn_materialize_scope(full_scope);
+
+	// collect prefixes of "bn/mean" keys first, folding edits the dict
+	size_t num_prefixes = 0;
+	size_t prefixes_capacity = 64;
+	char **prefixes = tnn_safe_malloc(prefixes_capacity * sizeof(char *));
+	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
+		tnn_state_entry_t *entry = tnn_state.state_dict[i];
+		while (entry != NULL) {
+			// keys outside the active scope have no relative key
+			if (!_tnn_key_in_scope(entry->key, full_scope)) {
+				entry = entry->next;
+				continue;
+			}
+			const char *key =
+			    _tnn_relative_key(entry->key, tnn_state.active_scope);
+			size_t key_len = strlen(key);
+			size_t suffix_len = strlen("bn/mean");
+
+			if (key_len >= suffix_len &&
+			    strcmp(key + key_len - suffix_len, "bn/mean") == 0 &&
+			    (key_len == suffix_len ||
+			     key[key_len - suffix_len - 1] == '/')) {
+				if (num_prefixes >= prefixes_capacity) {
+					prefixes_capacity *= 2;
+					prefixes = realloc(
+					    prefixes, prefixes_capacity * sizeof(char *)
+					);
+				}
+				// strip "/bn/mean" (or "bn/mean" at the root)
+				size_t prefix_len =
+				    key_len == suffix_len ? 0 : key_len - suffix_len - 1;
+				prefixes[num_prefixes++] = strndup(key, prefix_len);
+			}
+			entry = entry->next;
+		}
+	}
+
+	for (size_t i = 0; i < num_prefixes; i++) {
+		_fold_bn(prefixes[i]);
+		free(prefixes[i]);
+	}
+	free(prefixes);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// kernels shared by ops, one table per instruction set, see: tnn_backend_name()
+// - sgemm parallelizes itself, the rest runs on the calling thread
+typedef struct {
+	const char *name;
+
+	// C[M, N] (+)= A[M, K] @ B[K, N], A and B given transposed if tpose_*
+	void (*sgemm)(
+	    const float *a,
+	    const float *b,
+	    float *c,
+	    size_t m,
+	    size_t k,
+	    size_t n,
+	    bool tpose_a,
+	    bool tpose_b,
+	    bool accum
+	);
+	float (*dot)(const float *a, const float *b, size_t n);
+	// y += alpha * x
+	void (*axpy)(float *y, float alpha, const float *x, size_t n);
+	// see: src/impl/int8.h
+	int32_t (*dot_q8)(const int8_t *a, const int8_t *b, size_t n);
+} tnn_backend_t;
+
+// multiply-adds below which sgemm stays on the calling thread
+#define TNN_SGEMM_PARALLEL_MIN 65536
+
+// picked by tnn_init(), scalar before
+extern const tnn_backend_t *_tnn_backend;
+
+void _tnn_backend_init(void);
+
+// src/backend/*.c
+extern const tnn_backend_t _tnn_scalar_backend;
+#ifdef TNN_BACKEND_X86
+extern const tnn_backend_t _tnn_sse4_backend;
+extern const tnn_backend_t _tnn_avx2_backend;
+extern const tnn_backend_t _tnn_avx512_backend;
+extern const tnn_backend_t _tnn_avxvnni_backend;
+extern const tnn_backend_t _tnn_avx512vnni_backend;
+#endif
+
+// src/backend/blas.c, replaces sgemm of the picked backend
+#ifdef TNN_USE_BLAS
+void _tnn_blas_sgemm(
+    const float *a,
+    const float *b,
+    float *c,
+    size_t m,
+    size_t k,
+    size_t n,
+    bool tpose_a,
+    bool tpose_b,
+    bool accum
+);
+#endif
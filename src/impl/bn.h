@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tnn/tnn.h>
+
+// fixed number of row chunks, so that per-channel sums don't depend on the
+// thread count
+#define TNN_BN_NUM_CHUNKS 64
+// float partial sums are flushed to double every this many rows
+#define TNN_BN_BLOCK_ROWS 256
+
+// per-channel sums over rows of [NHW, C]:
+//   out_sum_a[c] = SUM[i]{a[i,c] - a_shift[c]}
+//   out_sum_ab[c] = SUM[i]{(a[i,c] - a_shift[c]) * (b[i,c] - b_shift[c])}
+void _tnn_bn_channel_sums(
+    const float *a,
+    const float *a_shift,
+    const float *b,
+    const float *b_shift,
+    size_t NHW,
+    size_t C,
+    double *out_sum_a,
+    double *out_sum_ab
+);
+
+// gets or creates "bn/mean" and "bn/var" of the active scope
+void _tnn_bn_running_stats(
+    size_t C, tnn_tensor_t **out_running_mean, tnn_tensor_t **out_running_var
+);
+
+// folds batch mean and (biased) variance into the running stats and returns
+// what to normalize with
+void _tnn_bn_update_stats(
+    const double *mean,
+    const double *var,
+    size_t C,
+    float momentum,
+    tnn_tensor_t *running_mean,
+    tnn_tensor_t *running_var,
+    float *out_mean,
+    float *out_std_inv
+);
+
+// what to normalize with in test mode
+void _tnn_bn_frozen_stats(
+    const tnn_tensor_t *running_mean,
+    const tnn_tensor_t *running_var,
+    size_t C,
+    float *out_mean,
+    float *out_std_inv
+);
+
+// accumulates dL/dx into input_grad given dL/dx' and x' = (x - u) * std_inv
+// - test: u and std_inv are constants
+void _tnn_bn_input_grad(
+    const float *grad,
+    const float *x_norm,
+    const float *std_inv,
+    bool test,
+    size_t NHW,
+    size_t C,
+    float *input_grad
+);
+
+// bf16 copy of a saved x', see: tnn_compact_activations()
+uint16_t *_tnn_bn_encode_bf16(const float *x, size_t n);
+float *_tnn_bn_decode_bf16(const uint16_t *x, size_t n);
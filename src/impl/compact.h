@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <tnn/tnn.h>
+
+#include "./malloc.h"
+#include "./state.h"
+
+// compact saved activations, see: tnn_compact_activations()
+
+// 1 bit per element, packed into 32-bit words
+static inline uint32_t *_tnn_mask_alloc(size_t n) {
+	return tnn_safe_malloc((n + 31) / 32 * sizeof(uint32_t));
+}
+
+// mask bit i = x[i] > 0, for the 32-aligned range [begin, end)
+static inline void
+_tnn_mask_positive(uint32_t *mask, const float *x, size_t begin, size_t end) {
+	for (size_t w = begin / 32; w < (end + 31) / 32; w++) {
+		size_t i0 = w * 32;
+		size_t n = end - i0 < 32 ? end - i0 : 32;
+		uint32_t bits = 0;
+		for (size_t j = 0; j < n; j++) {
+			bits |= (uint32_t)(x[i0 + j] > 0.0f) << j;
+		}
+		mask[w] = bits;
+	}
+}
+
+static inline bool _tnn_mask_get(const uint32_t *mask, size_t i) {
+	return (mask[i / 32] >> (i % 32)) & 1;
+}
+
+// round to nearest even (no NaNs expected)
+static inline uint16_t _tnn_to_bf16(float x) {
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	bits += 0x7fff + ((bits >> 16) & 1);
+	return (uint16_t)(bits >> 16);
+}
+
+static inline float _tnn_from_bf16(uint16_t x) {
+	uint32_t bits = (uint32_t)x << 16;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// backward of t won't read t->data
+static inline void _tnn_compact_output(tnn_tensor_t *t) {
+	if (tnn_state.compacting) {
+		t->compact = true;
+	}
+}
+
+// backward of t won't read t->parents[i_parent]->data
+static inline void _tnn_compact_parent(tnn_tensor_t *t, size_t i_parent) {
+	if (tnn_state.compacting) {
+		t->compact_parents |= (uint16_t)(1u << i_parent);
+	}
+}
+
+// frees data of the nodes (but loss, leaves and state) that no backward
+// reads, called by tnn_backward() before the pass
+// - nodes with children outside of nodes are kept
+void _tnn_release_activations(
+    tnn_tensor_t **nodes, size_t num_nodes, tnn_tensor_t *loss
+);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <tnn/tnn.h>
+
+// forward algorithms of _tnn_conv_forward(), 1x1 convs always run as a gemm
+typedef enum {
+	TNN_CONV_ALGO_DIRECT, // per output pixel and channel, default
+	TNN_CONV_ALGO_IM2COL, // gemm over blocks of gathered input patches
+	TNN_CONV_NUM_ALGOS,
+} tnn_conv_algo_t;
+
+// geometry of a conv over NHWC input, see: _tnn_conv()
+typedef struct {
+	size_t batch;
+	size_t h_in, w_in, c_in;
+	size_t h_out, w_out, c_out;
+	size_t kernel_size;
+	size_t stride;
+	size_t padding;
+	tnn_conv_algo_t algo; // see: _tnn_conv_autotune()
+} tnn_conv_shape_t;
+
+tnn_conv_shape_t _tnn_conv_shape(
+    const tnn_tensor_t *input,
+    size_t dim_out,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding
+);
+
+// [..., h_out, w_out, c_out] for input dims [..., h_in, w_in, c_in]
+void _tnn_conv_output_dims(
+    const tnn_conv_shape_t *shape, const tnn_tensor_t *input, size_t *out_dims
+);
+
+// gets "conv" weight of the active scope, xavier-initialized if new
+tnn_tensor_t *_tnn_conv_weight(const tnn_conv_shape_t *shape);
+
+// weight packed for blocked input, channels padded with zeros, see:
+// tnn_to_blocked()
+const float *_tnn_conv_blocked_weight(tnn_tensor_t *weight);
+
+// computes output pixels [pixel_begin, pixel_end), a pixel being all c_out
+// channels at one (b, i, j)
+void _tnn_conv_forward(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    float *output,
+    size_t pixel_begin,
+    size_t pixel_end
+);
+
+// all output pixels, in parallel
+void _tnn_conv_forward_parallel(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    float *output
+);
+
+// sets shape->algo: the direct one, or with tnn_conv_autotune() enabled, the
+// fastest one for the shape (timed on input and weight when first seen)
+void _tnn_conv_autotune(
+    tnn_conv_shape_t *shape, const float *input, const float *weight
+);
+
+// accumulates input and weight grads, either may be NULL
+void _tnn_conv_backward(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    const float *output_grad,
+    float *input_grad,
+    float *weight_grad
+);
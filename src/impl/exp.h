@@ -0,0 +1,67 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// branchless expf (cephes polynomial, ~1 ulp), loops over it vectorize
+// - inputs are clamped to the normal float range
+static inline float _tnn_expf(float x) {
+	x = x > 88.3762626647949f ? 88.3762626647949f : x;
+	x = x < -87.3365478515625f ? -87.3365478515625f : x;
+
+	// x = n * ln(2) + r, |r| <= ln(2) / 2
+	float n = floorf(x * 1.44269504088896341f + 0.5f);
+	float r = x - n * 0.693359375f;
+	r = r + n * 2.12194440e-4f;
+
+	float p = 1.9875691500e-4f;
+	p = p * r + 1.3981999507e-3f;
+	p = p * r + 8.3334519073e-3f;
+	p = p * r + 4.1665795894e-2f;
+	p = p * r + 1.6666665459e-1f;
+	p = p * r + 5.0000001201e-1f;
+	p = p * r * r + r + 1.0f;
+
+	// scale by 2^n
+	int32_t bits = ((int32_t)n + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(float));
+	return p * scale;
+}
+
+// elements per online log-sum-exp block, small enough to stay in L1
+#define TNN_LSE_BLOCK 64
+
+// folds x into a running (max, sum) pair, SUM{exp(x)} = sum * exp(max)
+// - start from max = -INFINITY, sum = 0
+// - a single pass over x, each block is re-read while still in L1
+static inline void
+_tnn_lse_update(float *max, float *sum, const float *x, size_t n) {
+	for (size_t i0 = 0; i0 < n; i0 += TNN_LSE_BLOCK) {
+		size_t i1 = i0 + TNN_LSE_BLOCK < n ? i0 + TNN_LSE_BLOCK : n;
+
+		float block_max = x[i0];
+		for (size_t i = i0 + 1; i < i1; i++) {
+			block_max = x[i] > block_max ? x[i] : block_max;
+		}
+		if (block_max > *max) {
+			*sum *= _tnn_expf(*max - block_max);
+			*max = block_max;
+		}
+
+		float m = *max, block_sum = 0.0f;
+		for (size_t i = i0; i < i1; i++) {
+			block_sum += _tnn_expf(x[i] - m);
+		}
+		*sum += block_sum;
+	}
+}
+
+// log(SUM{exp(x)})
+static inline float _tnn_log_sum_exp(const float *x, size_t n) {
+	float max = -INFINITY, sum = 0.0f;
+	_tnn_lse_update(&max, &sum, x, n);
+	return max + logf(sum);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// int8 rows are padded to whole 4-byte words so they can be stored in regular
+// float tensors (and saved with tnn_save())
+static inline size_t _tnn_q8_row_words(size_t row_len) {
+	return (row_len + 3) / 4;
+}
+
+static inline float _tnn_abs_max(const float *x, size_t n) {
+	float abs_max = 0.0f;
+	for (size_t i = 0; i < n; i++) {
+		float v = fabsf(x[i]);
+		abs_max = v > abs_max ? v : abs_max;
+	}
+	return abs_max;
+}
+
+// symmetric scale mapping [-abs_max, abs_max] onto [-127, 127]
+static inline float _tnn_q8_scale(float abs_max) {
+	return abs_max > 0.0f ? abs_max / 127.0f : 1.0f;
+}
+
+// -128 is never produced, which keeps the sign trick of the dot_q8 kernels
+// exact, see: src/impl/kernels.h
+static inline void
+_tnn_quantize_q8(int8_t *out, const float *x, size_t n, float scale) {
+	float inv_scale = 1.0f / scale;
+	for (size_t i = 0; i < n; i++) {
+		float q = nearbyintf(x[i] * inv_scale);
+		q = q > 127.0f ? 127.0f : (q < -127.0f ? -127.0f : q);
+		out[i] = (int8_t)q;
+	}
+}
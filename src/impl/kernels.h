@@ -0,0 +1,235 @@
+// backend kernels, compiled once per instruction set: each src/backend/*.c
+// defines TNN_KERNEL(name), TNN_KERNEL_NAME and one of TNN_KERNEL_SSE4,
+// TNN_KERNEL_AVX2 or TNN_KERNEL_AVX512 (none for scalar), plus
+// TNN_KERNEL_VNNI for dpbusd int8 dots, and gets the matching compiler flags
+// from CMakeLists.txt
+// - no include guard, included once per backend
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(TNN_KERNEL_SSE4) || defined(TNN_KERNEL_AVX2) ||                    \
+    defined(TNN_KERNEL_AVX512)
+#define TNN_KERNEL_SIMD
+#include <immintrin.h>
+#endif
+
+#include "./backend.h"
+#include "./malloc.h"
+
+#ifdef TNN_KERNEL_SIMD
+static inline float TNN_KERNEL(hsum)(__m128 x) {
+	x = _mm_hadd_ps(x, x);
+	x = _mm_hadd_ps(x, x);
+	return _mm_cvtss_f32(x);
+}
+
+static inline int32_t TNN_KERNEL(hsum_epi32)(__m128i x) {
+	x = _mm_hadd_epi32(x, x);
+	x = _mm_hadd_epi32(x, x);
+	return _mm_cvtsi128_si32(x);
+}
+#endif
+
+static float TNN_KERNEL(dot)(const float *a, const float *b, size_t n) {
+	float sum = 0.0f;
+	size_t i = 0;
+
+#if defined(TNN_KERNEL_AVX512)
+	__m512 acc = _mm512_setzero_ps();
+	for (; i + 16 <= n; i += 16) {
+		__m512 va = _mm512_loadu_ps(a + i);
+		acc = _mm512_fmadd_ps(va, _mm512_loadu_ps(b + i), acc);
+	}
+	sum = _mm512_reduce_add_ps(acc);
+#elif defined(TNN_KERNEL_AVX2)
+	__m256 acc = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		__m256 va = _mm256_loadu_ps(a + i);
+		acc = _mm256_fmadd_ps(va, _mm256_loadu_ps(b + i), acc);
+	}
+	sum = TNN_KERNEL(hsum)(_mm_add_ps(
+	    _mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)
+	));
+#elif defined(TNN_KERNEL_SSE4)
+	__m128 acc = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		__m128 va = _mm_loadu_ps(a + i);
+		acc = _mm_add_ps(acc, _mm_mul_ps(va, _mm_loadu_ps(b + i)));
+	}
+	sum = TNN_KERNEL(hsum)(acc);
+#endif
+
+	// scalar and tail
+	for (; i < n; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+static void TNN_KERNEL(axpy)(
+    float *restrict y, float alpha, const float *restrict x, size_t n
+) {
+	size_t i = 0;
+
+#if defined(TNN_KERNEL_AVX512)
+	__m512 va = _mm512_set1_ps(alpha);
+	for (; i + 16 <= n; i += 16) {
+		__m512 vy = _mm512_loadu_ps(y + i);
+		vy = _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), vy);
+		_mm512_storeu_ps(y + i, vy);
+	}
+#elif defined(TNN_KERNEL_AVX2)
+	__m256 va = _mm256_set1_ps(alpha);
+	for (; i + 8 <= n; i += 8) {
+		__m256 vy = _mm256_loadu_ps(y + i);
+		vy = _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), vy);
+		_mm256_storeu_ps(y + i, vy);
+	}
+#elif defined(TNN_KERNEL_SSE4)
+	__m128 va = _mm_set1_ps(alpha);
+	for (; i + 4 <= n; i += 4) {
+		__m128 vy = _mm_loadu_ps(y + i);
+		vy = _mm_add_ps(vy, _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+		_mm_storeu_ps(y + i, vy);
+	}
+#endif
+
+	for (; i < n; i++) {
+		y[i] += alpha * x[i];
+	}
+}
+
+// rows of C are accumulated in a row buffer (B rows) or computed as dots of
+// contiguous rows (B transposed), so the inner loops never stride
+// - rows are independent, results don't depend on the thread count
+static void TNN_KERNEL(sgemm)(
+    const float *a,
+    const float *b,
+    float *c,
+    size_t m,
+    size_t k,
+    size_t n,
+    bool tpose_a,
+    bool tpose_b,
+    bool accum
+) {
+#pragma omp parallel if (m * k * n >= TNN_SGEMM_PARALLEL_MIN)
+	{
+		float *row = tnn_safe_malloc((n > k ? n : k) * sizeof(float));
+
+#pragma omp for schedule(static)
+		for (size_t i_m = 0; i_m < m; i_m++) {
+			float *c_row = c + i_m * n;
+
+			if (!tpose_b) {
+				memset(row, 0, n * sizeof(float));
+				for (size_t i_k = 0; i_k < k; i_k++) {
+					float a_val = tpose_a ? a[i_k * m + i_m] : a[i_m * k + i_k];
+					TNN_KERNEL(axpy)(row, a_val, b + i_k * n, n);
+				}
+				for (size_t i_n = 0; i_n < n; i_n++) {
+					c_row[i_n] = accum ? c_row[i_n] + row[i_n] : row[i_n];
+				}
+				continue;
+			}
+
+			// gather column i_m of A
+			const float *a_row = a + i_m * k;
+			if (tpose_a) {
+				for (size_t i_k = 0; i_k < k; i_k++) {
+					row[i_k] = a[i_k * m + i_m];
+				}
+				a_row = row;
+			}
+			for (size_t i_n = 0; i_n < n; i_n++) {
+				float sum = TNN_KERNEL(dot)(a_row, b + i_n * k, k);
+				c_row[i_n] = accum ? c_row[i_n] + sum : sum;
+			}
+		}
+
+		free(row);
+	}
+}
+
+// u8 x s8 dot products: |a| is fed as unsigned and the sign of a moved onto b
+// - pairwise sums peak at 2 * 127 * 127, no int16 saturation
+// - vnni sums groups of 4 straight into int32 (dpbusd)
+static int32_t
+TNN_KERNEL(dot_q8)(const int8_t *a, const int8_t *b, size_t n) {
+	int32_t sum = 0;
+	size_t i = 0;
+
+#if defined(TNN_KERNEL_AVX512)
+	// no sign_epi8 in avx512, b is negated under a mask instead
+	__m512i acc512 = _mm512_setzero_si512();
+	for (; i + 64 <= n; i += 64) {
+		__m512i va = _mm512_loadu_si512((const void *)(a + i));
+		__m512i vb = _mm512_loadu_si512((const void *)(b + i));
+		__m512i ua = _mm512_abs_epi8(va);
+		__m512i sb = _mm512_mask_sub_epi8(
+		    vb, _mm512_movepi8_mask(va), _mm512_setzero_si512(), vb
+		);
+#ifdef TNN_KERNEL_VNNI
+		acc512 = _mm512_dpbusd_epi32(acc512, ua, sb);
+#else
+		__m512i pairs = _mm512_maddubs_epi16(ua, sb);
+		acc512 = _mm512_add_epi32(
+		    acc512, _mm512_madd_epi16(pairs, _mm512_set1_epi16(1))
+		);
+#endif
+	}
+	sum += _mm512_reduce_add_epi32(acc512);
+#endif
+
+#if defined(TNN_KERNEL_AVX512) || defined(TNN_KERNEL_AVX2)
+	__m256i acc256 = _mm256_setzero_si256();
+	for (; i + 32 <= n; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		__m256i ua = _mm256_abs_epi8(va);
+		__m256i sb = _mm256_sign_epi8(vb, va);
+#if defined(TNN_KERNEL_VNNI) && defined(TNN_KERNEL_AVX512)
+		acc256 = _mm256_dpbusd_epi32(acc256, ua, sb);
+#elif defined(TNN_KERNEL_VNNI)
+		acc256 = _mm256_dpbusd_avx_epi32(acc256, ua, sb);
+#else
+		__m256i pairs = _mm256_maddubs_epi16(ua, sb);
+		acc256 = _mm256_add_epi32(
+		    acc256, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1))
+		);
+#endif
+	}
+	sum += TNN_KERNEL(hsum_epi32)(_mm_add_epi32(
+	    _mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1)
+	));
+#endif
+
+#ifdef TNN_KERNEL_SIMD
+	__m128i acc128 = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i pairs =
+		    _mm_maddubs_epi16(_mm_abs_epi8(va), _mm_sign_epi8(vb, va));
+		acc128 =
+		    _mm_add_epi32(acc128, _mm_madd_epi16(pairs, _mm_set1_epi16(1)));
+	}
+	sum += TNN_KERNEL(hsum_epi32)(acc128);
+#endif
+
+	for (; i < n; i++) {
+		sum += (int32_t)a[i] * (int32_t)b[i];
+	}
+	return sum;
+}
+
+const tnn_backend_t TNN_KERNEL(backend) = {
+    .name = TNN_KERNEL_NAME,
+    .sgemm = TNN_KERNEL(sgemm),
+    .dot = TNN_KERNEL(dot),
+    .axpy = TNN_KERNEL(axpy),
+    .dot_q8 = TNN_KERNEL(dot_q8),
+};
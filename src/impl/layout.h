@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <tnn/tnn.h>
+
+// blocked channel layout, see: tnn_to_blocked()
+
+// last dim of a blocked tensor holding channels
+static inline size_t _tnn_blocked_dim(size_t channels) {
+	return (channels + TNN_BLOCK_CHANNELS - 1) / TNN_BLOCK_CHANNELS *
+	       TNN_BLOCK_CHANNELS;
+}
+
+// channels that carry data, padded lanes excluded
+static inline size_t _tnn_channels(const tnn_tensor_t *t) {
+	return t->channels != 0 ? t->channels : t->dims[t->num_dims - 1];
+}
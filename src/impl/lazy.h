@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tnn/tnn.h>
+
+// deferred elementwise ops, see: tnn_defer_elementwise()
+typedef enum {
+	TNN_LAZY_RELU, // relu(a)
+	TNN_LAZY_ADD,  // a + b, b may be broadcast over a's last dim (bias)
+} tnn_lazy_op_t;
+
+// tensor without data (data == NULL), see: tnn_realize()
+tnn_tensor_t *_tnn_alloc_deferred(const size_t *dims, size_t num_dims);
+
+// true while t has no data because it's deferred
+bool _tnn_is_deferred(const tnn_tensor_t *t);
+
+// unrealized output of op, shaped like a
+tnn_tensor_t *_tnn_defer(tnn_lazy_op_t op, tnn_tensor_t *a, tnn_tensor_t *b);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <tnn/tnn.h>
+
+// gets "proj" weight [dim_in, dim_out] of the active scope, xavier-initialized
+// if new, see: tnn_proj()
+tnn_tensor_t *_tnn_proj_weight(size_t dim_in, size_t dim_out);
+
+// gets "bias" [dim] of the active scope, zeroed if new, see: tnn_bias()
+tnn_tensor_t *_tnn_bias_param(size_t dim);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <tnn/tnn.h>
+
+// ref-counted file mapping shared by all tensors whose data points into it
+typedef struct tnn_mapping {
+	void *addr;
+	size_t len;
+	size_t num_refs;
+	struct tnn_offload *scratch; // owner of offloaded activations, or NULL
+} tnn_mapping_t;
+
+// see: src/offload.c
+void _tnn_offload_unmapped(struct tnn_offload *scratch);
+
+static inline void _tnn_mapping_retain(tnn_mapping_t *mapping) {
+	mapping->num_refs++;
+}
+
+static inline void _tnn_mapping_release(tnn_mapping_t *mapping) {
+	if (--mapping->num_refs == 0) {
+		munmap(mapping->addr, mapping->len);
+		if (mapping->scratch != NULL) {
+			_tnn_offload_unmapped(mapping->scratch);
+		}
+		free(mapping);
+	}
+}
+
+// tensor whose data is a view at byte offset into the mapping (no copy)
+tnn_tensor_t *_tnn_alloc_mapped(
+    const size_t *dims, size_t num_dims, tnn_mapping_t *mapping, size_t offset
+);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <tnn/tnn.h>
+
+#include "./state.h"
+
+// activation offload, see: tnn_offload()
+// - tensors allocated while enabled are tracked by the context until freed
+//   or offloaded, so they must be freed on the same context
+
+// called by tnn_alloc()
+void _tnn_offload_track(tnn_tensor_t *t);
+
+// called by tnn_free()
+void _tnn_offload_forget(tnn_tensor_t *t);
+
+// moves the oldest tracked activations to the scratch file while more than
+// the budget is resident, only called where no op holds data pointers
+void _tnn_offload_enforce(void);
+
+// nodes between the backward pass and the one being prefetched
+#define TNN_OFFLOAD_LOOKAHEAD 4
+
+// starts reading back the offloaded data of t and its parents
+void _tnn_offload_prefetch(tnn_tensor_t *t);
+
+// drops tracking, the scratch file is closed once nothing maps it
+void _tnn_offload_disable(tnn_state_t *ctx);
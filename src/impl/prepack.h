@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tnn/tnn.h>
+
+// packed copies of weights, see: tnn_prepack()
+typedef enum {
+	TNN_PACK_CONV_BLOCKED, // see: _tnn_conv_blocked_weight()
+} tnn_pack_kind_t;
+
+// listed on the weight, freed with it
+typedef struct tnn_packed {
+	tnn_pack_kind_t kind;
+	uint64_t version; // of the weight data it was packed from
+	float *data;
+	struct tnn_packed *next;
+} tnn_packed_t;
+
+// fills out from weight->data
+typedef void (*tnn_pack_fn_t)(const tnn_tensor_t *weight, float *out);
+
+// packs size floats of kind on the first call, and again in place once
+// weight->version moved on, so pointers stay valid for pending backwards
+const float *_tnn_packed(
+    tnn_tensor_t *weight, tnn_pack_kind_t kind, size_t size, tnn_pack_fn_t pack
+);
+
+void _tnn_packed_free(tnn_tensor_t *t);
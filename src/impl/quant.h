@@ -0,0 +1,6 @@
+#pragma once
+
+#include <tnn/tnn.h>
+
+// folds input abs-max into "<op_key>/act" while calibrating
+void _tnn_calibrate_observe(const char *op_key, tnn_tensor_t *input);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// counter-based streams: element i of a stream only depends on the context
+// seed, the stream id and i, so fills can run in parallel
+
+// stream of a state tensor, keyed by its full key (key relative to scope)
+uint64_t _tnn_state_stream(const char *key);
+
+// fresh stream for tensors without a key, see: tnn_init_randn()
+uint64_t _tnn_next_stream(void);
+
+// uniform in [lo, hi)
+void _tnn_fill_uniform(
+    float *out, size_t n, uint64_t stream, float lo, float hi
+);
+
+// standard normal
+void _tnn_fill_normal(float *out, size_t n, uint64_t stream);
@@ -1,16 +1,78 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <tnn/tnn.h>
+
 typedef struct tnn_state_entry {
 	char *key;
 	struct tnn_tensor *param;
 	struct tnn_state_entry *next;
 } tnn_state_entry_t;
 
+// state not materialized yet, see: tnn_load(filename, true)
+typedef struct tnn_pending_entry {
+	char *key;
+	size_t *dims;
+	size_t num_dims;
+	struct tnn_mapping *mapping; // retained until materialized
+	size_t offset;
+	struct tnn_pending_entry *next;
+} tnn_pending_entry_t;
+
 #define TNN_STATE_KEY_MAX_LEN 1024
 #define TNN_STATE_DICT_SIZE 256
 
-typedef struct {
+// see: tnn_ctx_create()
+typedef struct tnn_ctx {
 	char active_scope[TNN_STATE_KEY_MAX_LEN];
 	tnn_state_entry_t *state_dict[TNN_STATE_DICT_SIZE];
+	tnn_pending_entry_t *pending_dict[TNN_STATE_DICT_SIZE];
+	struct tnn_ctx *shared; // read-only fallback for lookups, may be NULL
+	uint64_t seed;             // see: tnn_seed()
+	uint64_t num_anon_streams; // see: _tnn_next_stream()
+	bool calibrating; // see: tnn_calibrate()
+	bool deferring;   // see: tnn_defer_elementwise()
+	bool compacting;  // see: tnn_compact_activations()
+	bool compact_bf16;
+	struct tnn_offload *offload; // see: tnn_offload(), may be NULL
 } tnn_state_t;
-extern tnn_state_t tnn_state;
+
+extern tnn_state_t _tnn_default_ctx;
+extern _Thread_local tnn_state_t *_tnn_bound_ctx;
+
+// context of the calling thread, see: tnn_ctx_bind()
+static inline tnn_state_t *_tnn_current_ctx(void) {
+	return _tnn_bound_ctx != NULL ? _tnn_bound_ctx : &_tnn_default_ctx;
+}
+#define tnn_state (*_tnn_current_ctx())
+
+// state tensors can be parents in graphs of concurrently running contexts
+// (see: tnn_ctx_create()), so their ref-count is updated atomically
+// - loaded state comes with requires_grad set, ops never write the flag of
+//   a shared checkpoint
+static inline void _tnn_retain_state(struct tnn_tensor *t) {
+	__atomic_fetch_add(&t->num_children, 1, __ATOMIC_RELAXED);
+}
+static inline void _tnn_require_grad(struct tnn_tensor *t) {
+	if (!t->requires_grad) {
+		t->requires_grad = true;
+	}
+}
+
+// removes exactly one entry (no sub-keys) and hands its tensor to the caller,
+// NULL if missing
+struct tnn_tensor *_tnn_take_state(const char *key);
+
+// registers a lazily loaded tensor (key relative to active scope)
+void _tnn_defer_state(
+    const char *key,
+    const size_t *dims,
+    size_t num_dims,
+    struct tnn_mapping *mapping,
+    size_t offset
+);
+
+// materializes every pending entry under the absolute scope
+void _tnn_materialize_scope(const char *scope);
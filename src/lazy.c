@@ -0,0 +1,337 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./impl/lazy.h"
+#include "./impl/malloc.h"
+#include "./impl/state.h"
+
+// elements evaluated per instruction before moving to the next one, all
+// intermediate values of a tile stay in L1
+#define LAZY_TILE 256
+// fixed so results don't depend on the thread count
+#define LAZY_NUM_CHUNKS 64
+
+typedef struct {
+	tnn_lazy_op_t op;
+} lazy_context_t;
+
+// a deferred chain compiled into a flat program, operands come first
+typedef enum { INSTR_LOAD, INSTR_RELU, INSTR_ADD } lazy_instr_kind_t;
+
+typedef struct {
+	lazy_instr_kind_t kind;
+	size_t a, b;        // operand instructions
+	tnn_tensor_t *leaf; // INSTR_LOAD
+	size_t leaf_size;   // less than the output size: broadcast, i % leaf_size
+	float *leaf_grad;   // per-chunk gradient rows of a broadcast leaf
+} lazy_instr_t;
+
+typedef struct {
+	lazy_instr_t *instrs;
+	size_t num_instrs;
+	size_t capacity;
+	size_t size; // elements of the output
+} lazy_program_t;
+
+static void lazy_backward(tnn_tensor_t *self);
+
+static bool _is_unrealized(const tnn_tensor_t *t) {
+	return t->data == NULL && t->backward == lazy_backward;
+}
+
+bool _tnn_is_deferred(const tnn_tensor_t *t) {
+	return _is_unrealized(t);
+}
+
+static size_t _emit(lazy_program_t *prog, lazy_instr_t instr) {
+	if (prog->num_instrs >= prog->capacity) {
+		prog->capacity = prog->capacity > 0 ? prog->capacity * 2 : 8;
+		prog->instrs =
+		    realloc(prog->instrs, prog->capacity * sizeof(lazy_instr_t));
+		assert(prog->instrs != NULL && "realloc failed");
+	}
+	prog->instrs[prog->num_instrs] = instr;
+	return prog->num_instrs++;
+}
+
+// inlines unrealized ancestors of node, everything else is loaded
+// - realizing: only ancestors consumed by this chain alone are inlined, the
+//   rest are realized first (and computed once)
+// - otherwise (backward): exactly the ancestors the forward pass inlined,
+//   they're the ones still without data
+static size_t _compile(
+    lazy_program_t *prog, tnn_tensor_t *node, tnn_tensor_t *root, bool realizing
+) {
+	bool inline_node = node == root;
+	if (!inline_node && _is_unrealized(node)) {
+		inline_node = !realizing || node->num_children == 1;
+	}
+
+	if (!inline_node) {
+		tnn_realize(node);
+		lazy_instr_t load = {.kind = INSTR_LOAD, .leaf = node};
+		load.leaf_size = tnn_size(node);
+		assert(prog->size % load.leaf_size == 0);
+		return _emit(prog, load);
+	}
+
+	lazy_context_t *ctx = (lazy_context_t *)node->context;
+	lazy_instr_t instr = {0};
+	instr.a = _compile(prog, node->parents[0], root, realizing);
+	if (ctx->op == TNN_LAZY_RELU) {
+		instr.kind = INSTR_RELU;
+	} else {
+		instr.kind = INSTR_ADD;
+		instr.b = _compile(prog, node->parents[1], root, realizing);
+	}
+	return _emit(prog, instr);
+}
+
+// values of every instruction over [i0, i0 + n), the last one goes to out
+// if not NULL
+static void _eval_tile(
+    const lazy_program_t *prog,
+    size_t i0,
+    size_t n,
+    float *regs,
+    const float **vals,
+    float *out
+) {
+	for (size_t k = 0; k < prog->num_instrs; k++) {
+		const lazy_instr_t *instr = &prog->instrs[k];
+		float *restrict dst = regs + k * LAZY_TILE;
+		if (k == prog->num_instrs - 1 && out != NULL) {
+			dst = out;
+		}
+
+		switch (instr->kind) {
+		case INSTR_LOAD:
+			if (instr->leaf_size == prog->size) {
+				vals[k] = instr->leaf->data + i0; // no copy
+				continue;
+			}
+			for (size_t j = 0, i = i0 % instr->leaf_size; j < n; j++) {
+				dst[j] = instr->leaf->data[i];
+				i = i + 1 < instr->leaf_size ? i + 1 : 0;
+			}
+			break;
+		case INSTR_RELU: {
+			const float *restrict a = vals[instr->a];
+			for (size_t j = 0; j < n; j++) {
+				dst[j] = a[j] > 0.0f ? a[j] : 0.0f;
+			}
+			break;
+		}
+		case INSTR_ADD: {
+			const float *restrict a = vals[instr->a];
+			const float *restrict b = vals[instr->b];
+			for (size_t j = 0; j < n; j++) {
+				dst[j] = a[j] + b[j];
+			}
+			break;
+		}
+		}
+		vals[k] = dst;
+	}
+}
+
+static void _chunk_range(
+    size_t size, size_t num_chunks, size_t chunk, size_t *begin, size_t *end
+) {
+	*begin = size * chunk / num_chunks;
+	*end = size * (chunk + 1) / num_chunks;
+}
+
+static size_t _num_chunks(size_t size) {
+	size_t num_tiles = (size + LAZY_TILE - 1) / LAZY_TILE;
+	return num_tiles < LAZY_NUM_CHUNKS ? num_tiles : LAZY_NUM_CHUNKS;
+}
+
+// fused backward of the whole inlined chain, intermediate values are
+// recomputed per tile and gradients go straight to the loaded tensors
+static void lazy_backward(tnn_tensor_t *self) {
+	if (self->data == NULL) {
+		return; // inlined into a consumer, its backward covered this node
+	}
+
+	lazy_program_t prog = {.size = tnn_size(self)};
+	_compile(&prog, self, self, false);
+	size_t num_chunks = _num_chunks(prog.size);
+
+	for (size_t k = 0; k < prog.num_instrs; k++) {
+		lazy_instr_t *instr = &prog.instrs[k];
+		if (instr->kind != INSTR_LOAD || !instr->leaf->requires_grad) {
+			continue;
+		}
+		if (instr->leaf->grad == NULL) {
+			instr->leaf->grad = calloc(instr->leaf_size, sizeof(float));
+			assert(instr->leaf->grad != NULL && "calloc failed");
+		}
+		if (instr->leaf_size < prog.size) {
+			instr->leaf_grad =
+			    calloc(num_chunks * instr->leaf_size, sizeof(float));
+			assert(instr->leaf_grad != NULL && "calloc failed");
+		}
+	}
+
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		size_t begin, end;
+		_chunk_range(prog.size, num_chunks, chunk, &begin, &end);
+		float *regs =
+		    tnn_safe_malloc(2 * prog.num_instrs * LAZY_TILE * sizeof(float));
+		float *grads = regs + prog.num_instrs * LAZY_TILE;
+		const float **vals =
+		    tnn_safe_malloc(prog.num_instrs * sizeof(const float *));
+
+		for (size_t i0 = begin; i0 < end; i0 += LAZY_TILE) {
+			size_t n = end - i0 < LAZY_TILE ? end - i0 : LAZY_TILE;
+			_eval_tile(&prog, i0, n, regs, vals, NULL);
+			memset(grads, 0, prog.num_instrs * LAZY_TILE * sizeof(float));
+
+			for (size_t k = prog.num_instrs; k-- > 0;) {
+				const lazy_instr_t *instr = &prog.instrs[k];
+				const float *restrict g = k == prog.num_instrs - 1
+				                              ? self->grad + i0
+				                              : grads + k * LAZY_TILE;
+
+				switch (instr->kind) {
+				case INSTR_LOAD: {
+					if (!instr->leaf->requires_grad) {
+						break;
+					}
+					if (instr->leaf_size == prog.size) {
+						float *restrict leaf_grad = instr->leaf->grad + i0;
+						for (size_t j = 0; j < n; j++) {
+							leaf_grad[j] += g[j];
+						}
+						break;
+					}
+					float *leaf_grad =
+					    instr->leaf_grad + chunk * instr->leaf_size;
+					for (size_t j = 0, i = i0 % instr->leaf_size; j < n;
+					     j++) {
+						leaf_grad[i] += g[j];
+						i = i + 1 < instr->leaf_size ? i + 1 : 0;
+					}
+					break;
+				}
+				case INSTR_RELU: {
+					// d(relu(a))/da = 1 if a > 0, else 0
+					const float *restrict a = vals[instr->a];
+					float *restrict grad_a = grads + instr->a * LAZY_TILE;
+					for (size_t j = 0; j < n; j++) {
+						grad_a[j] += a[j] > 0.0f ? g[j] : 0.0f;
+					}
+					break;
+				}
+				case INSTR_ADD: {
+					float *grad_a = grads + instr->a * LAZY_TILE;
+					float *grad_b = grads + instr->b * LAZY_TILE;
+					for (size_t j = 0; j < n; j++) {
+						grad_a[j] += g[j];
+					}
+					for (size_t j = 0; j < n; j++) {
+						grad_b[j] += g[j];
+					}
+					break;
+				}
+				}
+			}
+		}
+
+		free(vals);
+		free(regs);
+	}
+
+	// broadcast leaves: chunk rows summed in order
+	for (size_t k = 0; k < prog.num_instrs; k++) {
+		lazy_instr_t *instr = &prog.instrs[k];
+		if (instr->leaf_grad == NULL) {
+			continue;
+		}
+		for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+			const float *row = instr->leaf_grad + chunk * instr->leaf_size;
+			for (size_t i = 0; i < instr->leaf_size; i++) {
+				instr->leaf->grad[i] += row[i];
+			}
+		}
+		free(instr->leaf_grad);
+	}
+	free(prog.instrs);
+}
+
+void tnn_defer_elementwise(bool enabled) {
+	tnn_state.deferring = enabled;
+}
+
+void tnn_realize(tnn_tensor_t *t) {
+	assert(t != NULL);
+	if (!_is_unrealized(t)) {
+		return;
+	}
+
+	lazy_program_t prog = {.size = tnn_size(t)};
+	_compile(&prog, t, t, true);
+	t->data = tnn_safe_malloc(prog.size * sizeof(float));
+
+	size_t num_chunks = _num_chunks(prog.size);
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		size_t begin, end;
+		_chunk_range(prog.size, num_chunks, chunk, &begin, &end);
+		float *regs =
+		    tnn_safe_malloc(prog.num_instrs * LAZY_TILE * sizeof(float));
+		const float **vals =
+		    tnn_safe_malloc(prog.num_instrs * sizeof(const float *));
+
+		for (size_t i0 = begin; i0 < end; i0 += LAZY_TILE) {
+			size_t n = end - i0 < LAZY_TILE ? end - i0 : LAZY_TILE;
+			_eval_tile(&prog, i0, n, regs, vals, t->data + i0);
+		}
+
+		free(vals);
+		free(regs);
+	}
+
+	free(prog.instrs);
+}
+
+tnn_tensor_t *_tnn_defer(tnn_lazy_op_t op, tnn_tensor_t *a, tnn_tensor_t *b) {
+	assert(a != NULL);
+	assert((op == TNN_LAZY_ADD) == (b != NULL));
+	// b is either shaped like a or broadcast over a's last dim
+	assert(
+	    b == NULL || tnn_size(b) == tnn_size(a) ||
+	    (b->num_dims == 1 && b->dims[0] == a->dims[a->num_dims - 1])
+	);
+
+	tnn_tensor_t *output = _tnn_alloc_deferred(a->dims, a->num_dims);
+	output->channels = a->channels;
+
+	lazy_context_t *ctx = tnn_safe_malloc(sizeof(lazy_context_t));
+	ctx->op = op;
+
+	tnn_tensor_t *operands[2] = {a, b};
+	output->requires_grad = false;
+	for (size_t i = 0; i < 2 && operands[i] != NULL; i++) {
+		tnn_tensor_t *operand = operands[i];
+		output->parents[output->num_parents++] = operand;
+		if (operand->is_state) {
+			_tnn_retain_state(operand);
+		} else {
+			operand->num_children++;
+		}
+		output->requires_grad |= operand->requires_grad;
+	}
+	output->backward = lazy_backward;
+	output->context = ctx;
+	output->free_context = free;
+
+	return output;
+}
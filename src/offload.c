@@ -0,0 +1,221 @@
+#define _GNU_SOURCE // sync_file_range()
+
+#include <tnn/tnn.h>
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "./impl/malloc.h"
+#include "./impl/mapping.h"
+#include "./impl/offload.h"
+#include "./impl/state.h"
+
+typedef struct tnn_offload {
+	int fd;          // unlinked scratch file
+	size_t file_len; // bytes handed out, page-aligned
+	size_t budget;   // resident bytes of tracked activations
+	bool enabled;    // still owned by a context
+	size_t num_mappings;
+	tnn_tensor_t **tensors; // tracked while resident, oldest first
+	size_t num_tensors;
+	size_t capacity;
+} tnn_offload_t;
+
+static void _close(tnn_offload_t *o) {
+	close(o->fd);
+	free(o->tensors);
+	free(o);
+}
+
+void tnn_offload(const char *scratch_dir, size_t budget_bytes) {
+	_tnn_offload_disable(&tnn_state);
+	if (scratch_dir == NULL) {
+		return;
+	}
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/tnn-offload-XXXXXX", scratch_dir);
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		fprintf(stderr, "tnn_offload() failed to create in: %s\n", scratch_dir);
+		return;
+	}
+	// space is reclaimed once closed and unmapped
+	unlink(path);
+
+	tnn_offload_t *o = tnn_safe_malloc(sizeof(tnn_offload_t));
+	o->fd = fd;
+	o->file_len = 0;
+	o->budget = budget_bytes;
+	o->enabled = true;
+	o->num_mappings = 0;
+	o->capacity = 64;
+	o->tensors = tnn_safe_malloc(o->capacity * sizeof(tnn_tensor_t *));
+	o->num_tensors = 0;
+	tnn_state.offload = o;
+}
+
+void _tnn_offload_disable(tnn_state_t *ctx) {
+	tnn_offload_t *o = ctx->offload;
+	if (o == NULL) {
+		return;
+	}
+
+	ctx->offload = NULL;
+	o->enabled = false;
+	o->num_tensors = 0;
+	if (o->num_mappings == 0) {
+		_close(o);
+	}
+}
+
+void _tnn_offload_unmapped(tnn_offload_t *o) {
+	if (--o->num_mappings > 0) {
+		return;
+	}
+
+	if (!o->enabled) {
+		_close(o);
+		return;
+	}
+
+	// (usually once per step) reuse the file from the start
+	if (ftruncate(o->fd, 0) == 0) {
+		o->file_len = 0;
+	}
+}
+
+void _tnn_offload_track(tnn_tensor_t *t) {
+	tnn_offload_t *o = tnn_state.offload;
+	if (o == NULL) {
+		return;
+	}
+
+	if (o->num_tensors >= o->capacity) {
+		o->capacity *= 2;
+		o->tensors = realloc(o->tensors, o->capacity * sizeof(tnn_tensor_t *));
+	}
+	o->tensors[o->num_tensors++] = t;
+}
+
+void _tnn_offload_forget(tnn_tensor_t *t) {
+	tnn_offload_t *o = tnn_state.offload;
+	if (o == NULL || t->mapping != NULL) {
+		return;
+	}
+
+	// newest first, most tensors are freed soon after allocation
+	for (size_t i = o->num_tensors; i-- > 0;) {
+		if (o->tensors[i] == t) {
+			memmove(
+			    o->tensors + i,
+			    o->tensors + i + 1,
+			    (o->num_tensors - i - 1) * sizeof(tnn_tensor_t *)
+			);
+			o->num_tensors--;
+			return;
+		}
+	}
+}
+
+// data that a later backward may read
+static bool _is_activation(const tnn_tensor_t *t) {
+	return !t->is_state && t->mapping == NULL && t->data != NULL &&
+	       t->backward != NULL && t->requires_grad;
+}
+
+static bool _offload_tensor(tnn_offload_t *o, tnn_tensor_t *t) {
+	size_t num_bytes = tnn_size(t) * sizeof(float);
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size_t len = (num_bytes + page_size - 1) / page_size * page_size;
+	size_t offset = o->file_len;
+
+	if (ftruncate(o->fd, (off_t)(offset + len)) != 0) {
+		return false;
+	}
+	void *addr =
+	    mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, o->fd, offset);
+	if (addr == MAP_FAILED) {
+		return false;
+	}
+	o->file_len = offset + len;
+
+	memcpy(addr, t->data, num_bytes);
+	free(t->data);
+	t->data = addr;
+
+	t->mapping = tnn_safe_malloc(sizeof(tnn_mapping_t));
+	t->mapping->addr = addr;
+	t->mapping->len = len;
+	t->mapping->num_refs = 1; // held by t
+	t->mapping->scratch = o;
+	o->num_mappings++;
+
+	// start writing back now, so the pages are clean (cheap to reclaim) by the
+	// time memory runs short
+	sync_file_range(o->fd, offset, len, SYNC_FILE_RANGE_WRITE);
+#ifdef MADV_COLD
+	madvise(addr, len, MADV_COLD);
+#endif
+
+	return true;
+}
+
+void _tnn_offload_enforce(void) {
+	tnn_offload_t *o = tnn_state.offload;
+	if (o == NULL) {
+		return;
+	}
+
+	// untrack what is never offloaded, sum up the rest
+	size_t num_kept = 0;
+	size_t resident = 0;
+	for (size_t i = 0; i < o->num_tensors; i++) {
+		tnn_tensor_t *t = o->tensors[i];
+		if (_is_activation(t)) {
+			resident += tnn_size(t) * sizeof(float);
+			o->tensors[num_kept++] = t;
+		}
+	}
+	o->num_tensors = num_kept;
+
+	// the oldest are read last by backward
+	size_t num_offloaded = 0;
+	while (resident > o->budget && num_offloaded < o->num_tensors) {
+		tnn_tensor_t *t = o->tensors[num_offloaded];
+		if (!_offload_tensor(o, t)) {
+			fprintf(stderr, "tnn_offload() failed to grow the scratch file\n");
+			o->budget = SIZE_MAX; // stop trying
+			break;
+		}
+		resident -= tnn_size(t) * sizeof(float);
+		num_offloaded++;
+	}
+
+	memmove(
+	    o->tensors,
+	    o->tensors + num_offloaded,
+	    (o->num_tensors - num_offloaded) * sizeof(tnn_tensor_t *)
+	);
+	o->num_tensors -= num_offloaded;
+}
+
+static void _prefetch(const tnn_tensor_t *t) {
+	if (t->mapping != NULL && t->mapping->scratch != NULL) {
+		madvise(t->mapping->addr, t->mapping->len, MADV_WILLNEED);
+	}
+}
+
+void _tnn_offload_prefetch(tnn_tensor_t *t) {
+	_prefetch(t);
+	for (size_t i = 0; i < t->num_parents; i++) {
+		_prefetch(t->parents[i]);
+	}
+}
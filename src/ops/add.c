@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "../impl/compact.h"
+#include "../impl/lazy.h"
+#include "../impl/state.h"
+
 static void add_backward(tnn_tensor_t *self) {
 	tnn_tensor_t *a = self->parents[0];
 	tnn_tensor_t *b = self->parents[1];
@@ -34,9 +38,17 @@ tnn_tensor_t *tnn_add(tnn_tensor_t *a, tnn_tensor_t *b) {
 	for (size_t i = 0; i < a->num_dims; i++) {
 		assert(a->dims[i] == b->dims[i]);
 	}
+	assert(a->channels == b->channels && "mixed blocked and plain inputs");
+
+	if (tnn_state.deferring) {
+		return _tnn_defer(TNN_LAZY_ADD, a, b);
+	}
+	tnn_realize(a);
+	tnn_realize(b);
 
 	// alloc output with same dims as inputs
 	tnn_tensor_t *output = tnn_alloc(a->dims, a->num_dims);
+	output->channels = a->channels;
 
 	// output = a + b (element-wise)
 	size_t total_size = tnn_size(a);
@@ -51,6 +63,9 @@ tnn_tensor_t *tnn_add(tnn_tensor_t *a, tnn_tensor_t *b) {
 	a->num_children++;
 	b->num_children++;
 	output->backward = add_backward;
+	_tnn_compact_output(output);
+	_tnn_compact_parent(output, 0);
+	_tnn_compact_parent(output, 1);
 
 	return output;
 }
@@ -4,6 +4,11 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "../impl/compact.h"
+#include "../impl/lazy.h"
+#include "../impl/linear.h"
+#include "../impl/state.h"
+
 static void bias_backward(tnn_tensor_t *self) {
 	tnn_tensor_t *input = self->parents[0];
 	tnn_tensor_t *bias = self->parents[1];
@@ -31,8 +36,21 @@ static void bias_backward(tnn_tensor_t *self) {
 	}
 }
 
+tnn_tensor_t *_tnn_bias_param(size_t dim) {
+	size_t bias_dims[1] = {dim};
+	bool bias_created = false;
+	tnn_tensor_t *bias =
+	    tnn_alloc_or_get_state(bias_dims, 1, "bias", &bias_created);
+	_tnn_require_grad(bias);
+	if (bias_created) {
+		tnn_init_fill(bias, 0);
+	}
+	return bias;
+}
+
 tnn_tensor_t *tnn_bias(tnn_tensor_t *input) {
 	assert(input->num_dims >= 1);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
 
 	size_t dim_batch = 1;
 	for (size_t i = 0; i < input->num_dims - 1; i++) {
@@ -41,14 +59,12 @@ tnn_tensor_t *tnn_bias(tnn_tensor_t *input) {
 	size_t dim_in = input->dims[input->num_dims - 1];
 
 	// get bias parameter
-	size_t bias_dims[1] = {dim_in};
-	bool bias_created = false;
-	tnn_tensor_t *bias =
-	    tnn_alloc_or_get_state(bias_dims, 1, "bias", &bias_created);
-	bias->requires_grad = true;
-	if (bias_created) {
-		tnn_init_fill(bias, 0);
+	tnn_tensor_t *bias = _tnn_bias_param(dim_in);
+
+	if (tnn_state.deferring) {
+		return _tnn_defer(TNN_LAZY_ADD, input, bias);
 	}
+	tnn_realize(input);
 
 	// alloc output with same dims as input
 	tnn_tensor_t *output = tnn_alloc(input->dims, input->num_dims);
@@ -66,8 +82,10 @@ tnn_tensor_t *tnn_bias(tnn_tensor_t *input) {
 	output->parents[1] = bias;
 	output->num_parents = 2;
 	input->num_children++;
-	bias->num_children++;
+	_tnn_retain_state(bias);
 	output->backward = bias_backward;
+	_tnn_compact_output(output);
+	_tnn_compact_parent(output, 0);
 
 	return output;
 }
@@ -4,24 +4,308 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "../impl/bn.h"
+#include "../impl/compact.h"
+#include "../impl/layout.h"
 #include "../impl/malloc.h"
 
 typedef struct {
 	size_t NHW;
 	size_t C;
-	float momentum;
-	float test;
-	float *running_var; // for test mode; internal tensor data; DO NOT FREE
-	float *batch_var;
+	bool test;
+	float *std_inv; // [C], of batch stats in train mode, running in test mode
+	uint16_t *x_norm_bf16; // [NHW, C], output copy, NULL: output data is read
 } bn_context_t;
 
 static void bn_free_context(void *ctx) {
 	bn_context_t *bn_ctx = (bn_context_t *)ctx;
-	free(bn_ctx->batch_var);
+	free(bn_ctx->std_inv);
+	free(bn_ctx->x_norm_bf16);
 	free(bn_ctx);
 }
 
+// rows are streamed once and contiguously, accumulating across channels,
+// shifts keep the variance sum from cancelling catastrophically
+void _tnn_bn_channel_sums(
+    const float *a,
+    const float *a_shift,
+    const float *b,
+    const float *b_shift,
+    size_t NHW,
+    size_t C,
+    double *out_sum_a,
+    double *out_sum_ab
+) {
+	size_t num_chunks = NHW < TNN_BN_NUM_CHUNKS ? NHW : TNN_BN_NUM_CHUNKS;
+	double *partial = tnn_safe_malloc(num_chunks * 2 * C * sizeof(double));
+
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		double *chunk_a = partial + chunk * 2 * C;
+		double *chunk_ab = chunk_a + C;
+		memset(chunk_a, 0, 2 * C * sizeof(double));
+
+		float *block = tnn_safe_malloc(2 * C * sizeof(float));
+		float *restrict block_a = block;
+		float *restrict block_ab = block + C;
+
+		size_t row_end = NHW * (chunk + 1) / num_chunks;
+		for (size_t r0 = NHW * chunk / num_chunks; r0 < row_end;
+		     r0 += TNN_BN_BLOCK_ROWS) {
+			size_t r1 = r0 + TNN_BN_BLOCK_ROWS;
+			if (r1 > row_end) {
+				r1 = row_end;
+			}
+
+			memset(block, 0, 2 * C * sizeof(float));
+			for (size_t r = r0; r < r1; r++) {
+				const float *a_row = a + r * C;
+				const float *b_row = b + r * C;
+				for (size_t c = 0; c < C; c++) {
+					float da = a_row[c] - a_shift[c];
+					block_a[c] += da;
+					block_ab[c] += da * (b_row[c] - b_shift[c]);
+				}
+			}
+
+			for (size_t c = 0; c < C; c++) {
+				chunk_a[c] += block_a[c];
+				chunk_ab[c] += block_ab[c];
+			}
+		}
+
+		free(block);
+	}
+
+	// merge in chunk order
+	memset(out_sum_a, 0, C * sizeof(double));
+	memset(out_sum_ab, 0, C * sizeof(double));
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		const double *chunk_a = partial + chunk * 2 * C;
+		const double *chunk_ab = chunk_a + C;
+		for (size_t c = 0; c < C; c++) {
+			out_sum_a[c] += chunk_a[c];
+			out_sum_ab[c] += chunk_ab[c];
+		}
+	}
+
+	free(partial);
+}
+
+void _tnn_bn_running_stats(
+    size_t C, tnn_tensor_t **out_running_mean, tnn_tensor_t **out_running_var
+) {
+	// get or create running statistics as buffers (state without grad)
+	size_t stats_dims[1] = {C};
+	bool running_mean_created = false;
+	bool running_var_created = false;
+
+	*out_running_mean =
+	    tnn_alloc_or_get_state(stats_dims, 1, "bn/mean", &running_mean_created);
+	*out_running_var =
+	    tnn_alloc_or_get_state(stats_dims, 1, "bn/var", &running_var_created);
+	if (running_mean_created) {
+		tnn_init_fill(*out_running_mean, 0);
+	}
+	if (running_var_created) {
+		tnn_init_fill(*out_running_var, 1);
+	}
+}
+
+void _tnn_bn_update_stats(
+    const double *mean,
+    const double *var,
+    size_t C,
+    float momentum,
+    tnn_tensor_t *running_mean,
+    tnn_tensor_t *running_var,
+    float *out_mean,
+    float *out_std_inv
+) {
+	for (size_t c = 0; c < C; c++) {
+		float batch_mean = (float)mean[c];
+		float batch_var = var[c] > 0.0 ? (float)var[c] : 0.0f;
+
+		// update running stats
+		running_mean->data[c] = momentum * running_mean->data[c] +
+		                        (1.0f - momentum) * batch_mean;
+		running_var->data[c] =
+		    momentum * running_var->data[c] + (1.0f - momentum) * batch_var;
+
+		out_mean[c] = batch_mean;
+		out_std_inv[c] = 1.0f / sqrtf(batch_var + 1e-5f);
+	}
+}
+
+void _tnn_bn_frozen_stats(
+    const tnn_tensor_t *running_mean,
+    const tnn_tensor_t *running_var,
+    size_t C,
+    float *out_mean,
+    float *out_std_inv
+) {
+	for (size_t c = 0; c < C; c++) {
+		out_mean[c] = running_mean->data[c];
+		out_std_inv[c] = 1.0f / sqrtf(running_var->data[c] + 1e-5f);
+	}
+}
+
+void _tnn_bn_input_grad(
+    const float *grad,
+    const float *x_norm,
+    const float *std_inv,
+    bool test,
+    size_t NHW,
+    size_t C,
+    float *input_grad
+) {
+	if (test) {
+		//   x' = (x - u) / s
+		//   x' = c / s
+		// where: c = x - mean
+		//   dx'/dx = dx'/dc * dc/dx
+		//   dx'/dc = 1/s
+		//   dc/dx = 1
+		// thus:
+		//   dx'/dx = 1/s
+		// finally apply chain rule with incoming gradient dL/dx':
+		//   dL/dx = dL/dx' / s
+
+#pragma omp parallel for schedule(static)
+		for (size_t r = 0; r < NHW; r++) {
+			const float *grad_row = grad + r * C;
+			float *input_grad_row = input_grad + r * C;
+			for (size_t c = 0; c < C; c++) {
+				input_grad_row[c] += grad_row[c] * std_inv[c];
+			}
+		}
+		return;
+	}
+
+		// clang-format off
+		// in training, the gradient flows through immediate stats of the
+		// batch:
+		//   x' = (x - u) / s
+		//   u = SUM[i]{x[i]} / N
+		//   s = sqrt(SUM[i]{(x[i] - u)^2} / N)
+        // where: N = NHW (all batch dims together)
+		//
+		//   dL/dx = dL/dx' * dx'/dx
+		//   dL/dx' -> KNOWN; = grad
+		// from quotient rule:
+		//   dx'/dx = (d(x-u)/dx*s - (x-u)*ds/dx) / s^2
+        // with indices:
+        //   dx'[j]/dx[i] = (d(x[j]-u)/dx[i]*s - (x[j]-u)*ds/dx[i]) / s^2
+        //
+        // x minus mean gradient:
+		//   d(x[j]-u)/dx[i] = dx[j]/dx[i] - du/dx[i]
+		// note: dx[j]/dx[i] is the identity matrix I (ones for i=j cells)
+		//   du/dx[i] = 1/N
+		// remember: this is a vector of
+		// derivatives wrt each element x[i], and other elements are
+		// independent -> they zero-out
+        //   d(x[j]-u)/dx[i] = I[i,j] - 1/N
+        //
+        // standard deviation gradient:
+		//   ds/dx[i] = d(sqrt(SUM[j]{(x[j]-u)^2}/N))/dx[i]
+		//            = 1/(2*sqrt(SUM[j]{(x[j]-u)^2}/N)) * (1/N) * SUM[j]{d((x[j]-u)^2)/dx[i]}
+        //   d((x[j]-u)^2)/dx[i] = 2(x[j]-u) * d(x[j]-u)/dx[i]
+        //   d(x[j]-u)/dx[i] -> ALREADY COMPUTED
+        // plugging d(x[j]-u)/dx[i] into ds/dx[i]:
+        //   ds/dx[i] = 1/(2*sqrt(SUM[j]{(x[j]-u)^2}/N)) * (1/N) * SUM[j]{2(x[j]-u)*(I[i,j]-1/N)}
+        // where: I is identity matrix
+        //   ds/dx[i] = SUM[j]{2(x[j]-u)*(I[i,j]-1/N)} / (2N*sqrt(SUM[j]{(x[j]-u)^2}/N))
+        //            = SUM[j]{(x[j]-u)*(I[i,j]-1/N)} / (N*sqrt(SUM[j]{(x[j] - u)^2}/N))
+        //            = [ SUM[j]{(x[j]-u)*I[i,j]} + SUM[j]{(x[j]-u)*(-1/N)} ] / ...
+        //   SUM[j]{(x[j] - u) * I[i,j]} = x[i] - u
+        // because: I[i,j]=1 only for i=j
+        //   SUM[j]{(x[j] - u) * (-1/N)} = 0
+        // because: summing all centered elements = 0
+        // also notice:
+        //   sqrt(SUM[j]{(x[j] - u)^2}/N) = s
+        // thus:
+        //   ds/dx[i] = (x[i] - u) / Ns
+        //
+        // finally:
+        //   dx'[j]/dx[i] = ((I[i,j] - 1/N)*s - (x[j]-u)*((x[i] - u) / Ns)) / s^2
+        //                = (I[i,j]-1/N)/s - (x[j]-u)*(x[i]-u)/Ns^3
+        // plugging into full loss formula:
+        //   dL/dx[i] = SUM[j]{dL/dx'[j] * dx'[j]/dx[i]}
+        //            = SUM[j]{dL/dx'[j] * [(I[i,j]-1/N)/s - (x[j]-u)*(x[i]-u)/Ns^3]}
+        // split the sum:
+        //            = SUM[j]{dL/dx'[j] * (I[i,j]-1/N)/s} - SUM[j]{dL/dx'[j] * (x[j]-u)*(x[i]-u)/Ns^3}
+        // first term:
+        //   (1/s) * [dL/dx'[i] - (1/N)*SUM[j]{dL/dx'[j]}] ...
+        // second term (factor out (x[i]-u)/Ns^2):
+        //   ... - (x[i]-u)/Ns^2 * SUM[j]{dL/dx'[j] * (x[j]-u)/s}
+        // combine and use x'[i] = (x[i]-u)/s:
+        //   dL/dx[i] = dL/dx'[i] * (1/s) - (1/N)*(1/s)*SUM[j]{dL/dx'[j]} 
+        //           - x'[i] * (1/Ns) * SUM[j]{dL/dx'[j] * x'[j]}
+        //
+        // let K = 1/Ns:
+        //   dL/dx[i] = dL/dx'[i] * (1/s) - ( SUM[j]{dL/dx'[j]} + x'[i]*SUM[j]{dL/dx'[j]*x'[j]} ) * K
+        //
+        // in the following implementation:
+        //   x_norm[j] = x'[j]
+        //   sum_grad = SUM[j]{dL/dx'[j]}
+        //   sum_grad_x_norm = SUM[j]{dL/dx'[j]*x'[j]}
+        //   k = K
+		// clang-format on
+
+	float *zeros = calloc(C, sizeof(float));
+	double *sum_grad = tnn_safe_malloc(2 * C * sizeof(double));
+	double *sum_grad_x_norm = sum_grad + C;
+	_tnn_bn_channel_sums(
+	    grad, zeros, x_norm, zeros, NHW, C, sum_grad, sum_grad_x_norm
+	);
+
+	// k and both sums folded into per-channel float coefficients
+	float *coefs = tnn_safe_malloc(2 * C * sizeof(float));
+	float *k_sum_grad = coefs;
+	float *k_sum_grad_x_norm = coefs + C;
+	for (size_t c = 0; c < C; c++) {
+		float k = std_inv[c] / NHW;
+		k_sum_grad[c] = (float)sum_grad[c] * k;
+		k_sum_grad_x_norm[c] = (float)sum_grad_x_norm[c] * k;
+	}
+
+#pragma omp parallel for schedule(static)
+	for (size_t r = 0; r < NHW; r++) {
+		const float *grad_row = grad + r * C;
+		const float *x_norm_row = x_norm + r * C;
+		float *input_grad_row = input_grad + r * C;
+		for (size_t c = 0; c < C; c++) {
+			input_grad_row[c] += grad_row[c] * std_inv[c] - k_sum_grad[c] -
+			                     x_norm_row[c] * k_sum_grad_x_norm[c];
+		}
+	}
+
+	free(coefs);
+	free(sum_grad);
+	free(zeros);
+}
+
+uint16_t *_tnn_bn_encode_bf16(const float *x, size_t n) {
+	uint16_t *out = tnn_safe_malloc(n * sizeof(uint16_t));
+#pragma omp parallel for schedule(static)
+	for (size_t i = 0; i < n; i++) {
+		out[i] = _tnn_to_bf16(x[i]);
+	}
+	return out;
+}
+
+float *_tnn_bn_decode_bf16(const uint16_t *x, size_t n) {
+	float *out = tnn_safe_malloc(n * sizeof(float));
+#pragma omp parallel for schedule(static)
+	for (size_t i = 0; i < n; i++) {
+		out[i] = _tnn_from_bf16(x[i]);
+	}
+	return out;
+}
+
 static void bn_backward(tnn_tensor_t *self) {
 	tnn_tensor_t *input = self->parents[0];
 
@@ -32,117 +316,23 @@ static void bn_backward(tnn_tensor_t *self) {
 	assert(self->context != NULL);
 	bn_context_t *ctx = (bn_context_t *)self->context;
 
-	size_t NHW = ctx->NHW;
-	size_t C = ctx->C;
-	size_t NHWC = NHW * C;
+	float *x_norm = self->data;
+	if (ctx->x_norm_bf16 != NULL) {
+		x_norm = _tnn_bn_decode_bf16(ctx->x_norm_bf16, ctx->NHW * ctx->C);
+	}
 
-	for (size_t c = 0; c < C; c++) {
-		if (ctx->test) {
-			//   x' = (x - u) / s
-			//   x' = c / s
-			// where: c = x - mean
-			//   dx'/dx = dx'/dc * dc/dx
-			//   dx'/dc = 1/s
-			//   dc/dx = 1
-			// thus:
-			//   dx'/dx = 1/s
-			// finally apply chain rule with incoming gradient dL/dx':
-			//   dL/dx = dL/dx' / s
-
-			float var = ctx->running_var[c];
-			float std_inv = 1.0f / sqrtf(var + 1e-5);
-
-			for (size_t idx = c; idx < NHWC; idx += C) {
-				input->grad[idx] += self->grad[idx] * std_inv;
-			}
-		} else {
-			// clang-format off
-			// in training, the gradient flows through immediate stats of the
-			// batch:
-			//   x' = (x - u) / s
-			//   u = SUM[i]{x[i]} / N
-			//   s = sqrt(SUM[i]{(x[i] - u)^2} / N)
-            // where: N = NHW (all batch dims together)
-			//
-			//   dL/dx = dL/dx' * dx'/dx
-			//   dL/dx' -> KNOWN; = self->grad
-			// from quotient rule:
-			//   dx'/dx = (d(x-u)/dx*s - (x-u)*ds/dx) / s^2
-            // with indices:
-            //   dx'[j]/dx[i] = (d(x[j]-u)/dx[i]*s - (x[j]-u)*ds/dx[i]) / s^2
-            //
-            // x minus mean gradient:
-			//   d(x[j]-u)/dx[i] = dx[j]/dx[i] - du/dx[i]
-			// note: dx[j]/dx[i] is the identity matrix I (ones for i=j cells)
-			//   du/dx[i] = 1/N
-			// remember: this is a vector of
-			// derivatives wrt each element x[i], and other elements are
-			// independent -> they zero-out
-            //   d(x[j]-u)/dx[i] = I[i,j] - 1/N
-            //
-            // standard deviation gradient:
-			//   ds/dx[i] = d(sqrt(SUM[j]{(x[j]-u)^2}/N))/dx[i]
-			//            = 1/(2*sqrt(SUM[j]{(x[j]-u)^2}/N)) * (1/N) * SUM[j]{d((x[j]-u)^2)/dx[i]}
-            //   d((x[j]-u)^2)/dx[i] = 2(x[j]-u) * d(x[j]-u)/dx[i]
-            //   d(x[j]-u)/dx[i] -> ALREADY COMPUTED
-            // plugging d(x[j]-u)/dx[i] into ds/dx[i]:
-            //   ds/dx[i] = 1/(2*sqrt(SUM[j]{(x[j]-u)^2}/N)) * (1/N) * SUM[j]{2(x[j]-u)*(I[i,j]-1/N)}
-            // where: I is identity matrix
-            //   ds/dx[i] = SUM[j]{2(x[j]-u)*(I[i,j]-1/N)} / (2N*sqrt(SUM[j]{(x[j]-u)^2}/N))
-            //            = SUM[j]{(x[j]-u)*(I[i,j]-1/N)} / (N*sqrt(SUM[j]{(x[j] - u)^2}/N))
-            //            = [ SUM[j]{(x[j]-u)*I[i,j]} + SUM[j]{(x[j]-u)*(-1/N)} ] / ...
-            //   SUM[j]{(x[j] - u) * I[i,j]} = x[i] - u
-            // because: I[i,j]=1 only for i=j
-            //   SUM[j]{(x[j] - u) * (-1/N)} = 0
-            // because: summing all centered elements = 0
-            // also notice:
-            //   sqrt(SUM[j]{(x[j] - u)^2}/N) = s
-            // thus:
-            //   ds/dx[i] = (x[i] - u) / Ns
-            //
-            // finally:
-            //   dx'[j]/dx[i] = ((I[i,j] - 1/N)*s - (x[j]-u)*((x[i] - u) / Ns)) / s^2
-            //                = (I[i,j]-1/N)/s - (x[j]-u)*(x[i]-u)/Ns^3
-            // plugging into full loss formula:
-            //   dL/dx[i] = SUM[j]{dL/dx'[j] * dx'[j]/dx[i]}
-            //            = SUM[j]{dL/dx'[j] * [(I[i,j]-1/N)/s - (x[j]-u)*(x[i]-u)/Ns^3]}
-            // split the sum:
-            //            = SUM[j]{dL/dx'[j] * (I[i,j]-1/N)/s} - SUM[j]{dL/dx'[j] * (x[j]-u)*(x[i]-u)/Ns^3}
-            // first term:
-            //   (1/s) * [dL/dx'[i] - (1/N)*SUM[j]{dL/dx'[j]}] ...
-            // second term (factor out (x[i]-u)/Ns^2):
-            //   ... - (x[i]-u)/Ns^2 * SUM[j]{dL/dx'[j] * (x[j]-u)/s}
-            // combine and use x'[i] = (x[i]-u)/s:
-            //   dL/dx[i] = dL/dx'[i] * (1/s) - (1/N)*(1/s)*SUM[j]{dL/dx'[j]} 
-            //           - x'[i] * (1/Ns) * SUM[j]{dL/dx'[j] * x'[j]}
-            //
-            // let K = 1/Ns:
-            //   dL/dx[i] = dL/dx'[i] * (1/s) - ( SUM[j]{dL/dx'[j]} + x'[i]*SUM[j]{dL/dx'[j]*x'[j]} ) * K
-            //
-            // in the following implementation:
-            //   x_norm = self->data[idx] = x'[j]
-            //   sum_grad = SUM[j]{dL/dx'[j]}
-            //   sum_grad_x_norm = SUM[j]{dL/dx'[j]*x'[j]}
-            //   k = K
-			// clang-format on
-
-			float var = ctx->batch_var[c];
-			float std_inv = 1.0f / sqrtf(var + 1e-5f);
-
-			float sum_grad = 0.0f;
-			float sum_grad_x_norm = 0.0f;
-			for (size_t idx = c; idx < NHWC; idx += C) {
-				sum_grad += self->grad[idx];
-				sum_grad_x_norm += self->grad[idx] * self->data[idx];
-			}
+	_tnn_bn_input_grad(
+	    self->grad,
+	    x_norm,
+	    ctx->std_inv,
+	    ctx->test,
+	    ctx->NHW,
+	    ctx->C,
+	    input->grad
+	);
 
-			float k = std_inv / NHW;
-			for (size_t idx = c; idx < NHWC; idx += C) {
-				input->grad[idx] +=
-				    self->grad[idx] * std_inv -
-				    (sum_grad + self->data[idx] * sum_grad_x_norm) * k;
-			}
-		}
+	if (x_norm != self->data) {
+		free(x_norm);
 	}
 }
 
@@ -150,6 +340,13 @@ tnn_tensor_t *tnn_bn(tnn_tensor_t *input, float momentum, bool test) {
 	assert(input != NULL);
 	assert(input->num_dims >= 4); // [..., H, W, C]
 	assert(momentum >= 0.0f && momentum <= 1.0f);
+	tnn_realize(input);
+
+	// already folded into the preceding conv, see: tnn_fold_bn()
+	if (tnn_get_state("bn/folded") != NULL) {
+		assert(test && "folded bn is inference-only");
+		return input;
+	}
 
 	size_t N = 1; // batch size
 	for (size_t i = 0; i < input->num_dims - 3; i++) {
@@ -159,76 +356,75 @@ tnn_tensor_t *tnn_bn(tnn_tensor_t *input, float momentum, bool test) {
 	size_t W = input->dims[input->num_dims - 2]; // width
 	size_t C = input->dims[input->num_dims - 1]; // channels
 	size_t NHW = N * H * W;
-	size_t NHWC = NHW * C;
-
-	// get or create running statistics as buffers (state without grad)
-	size_t stats_dims[1] = {C};
-	bool running_mean_created = false;
-	bool running_var_created = false;
+	// running stats skip padded lanes of blocked input, see: tnn_to_blocked()
+	size_t C_stats = _tnn_channels(input);
 
-	tnn_tensor_t *running_mean =
-	    tnn_alloc_or_get_state(stats_dims, 1, "bn/mean", &running_mean_created);
-	tnn_tensor_t *running_var =
-	    tnn_alloc_or_get_state(stats_dims, 1, "bn/var", &running_var_created);
-	if (running_mean_created) {
-		tnn_init_fill(running_mean, 0);
-	}
-	if (running_var_created) {
-		tnn_init_fill(running_var, 1);
-	}
+	tnn_tensor_t *running_mean, *running_var;
+	_tnn_bn_running_stats(C_stats, &running_mean, &running_var);
 
 	// alloc output with same dims as input
 	tnn_tensor_t *output = tnn_alloc(input->dims, input->num_dims);
+	output->channels = input->channels;
 
 	// create context for backward pass
 	bn_context_t *ctx = tnn_safe_malloc(sizeof(bn_context_t));
 	ctx->NHW = NHW;
 	ctx->C = C;
-	ctx->momentum = momentum;
 	ctx->test = test;
-	ctx->running_var = running_var->data;
-	if (!test) {
-		ctx->batch_var = tnn_safe_malloc(C * sizeof(float));
-	}
-
-	// forward pass: compute batch statistics and normalize
-	for (size_t c = 0; c < C; c++) {
-		float mean, var;
-		if (test) {
-			mean = running_mean->data[c];
-			var = running_var->data[c];
-		} else {
-			// compute mean for this channel
-			float sum = 0.0f;
-			for (size_t idx = c; idx < NHWC; idx += C) {
-				sum += input->data[idx];
-			}
-			mean = sum / NHW;
+	ctx->std_inv = tnn_safe_malloc(C * sizeof(float));
+	ctx->x_norm_bf16 = NULL;
 
-			// compute variance
-			float var_sum = 0.0f;
-			for (size_t idx = c; idx < NHWC; idx += C) {
-				float diff = input->data[idx] - mean;
-				var_sum += diff * diff;
-			}
-			var = var_sum / NHW;
+	float *mean = tnn_safe_malloc(C * sizeof(float));
+	if (test) {
+		_tnn_bn_frozen_stats(
+		    running_mean, running_var, C_stats, mean, ctx->std_inv
+		);
+	} else {
+		// single pass over the batch, shifted by the first row
+		const float *shift = input->data;
+		double *sums = tnn_safe_malloc(4 * C * sizeof(double));
+		double *sum = sums, *sum_sq = sums + C;
+		double *batch_mean = sums + 2 * C, *batch_var = sums + 3 * C;
+		_tnn_bn_channel_sums(
+		    input->data, shift, input->data, shift, NHW, C, sum, sum_sq
+		);
 
-			// update running stats
-			running_mean->data[c] =
-			    momentum * running_mean->data[c] + (1.0f - momentum) * mean;
-			running_var->data[c] =
-			    momentum * running_var->data[c] + (1.0f - momentum) * var;
-
-			// pass immediate stats to backward for use in train mode
-			ctx->batch_var[c] = var;
+		for (size_t c = 0; c < C; c++) {
+			double shifted_mean = sum[c] / NHW;
+			batch_mean[c] = shift[c] + shifted_mean;
+			batch_var[c] = sum_sq[c] / NHW - shifted_mean * shifted_mean;
 		}
 
-		// normalize
-		float std_inv = 1 / sqrtf(var + 1e-5);
-		for (size_t idx = c; idx < NHWC; idx += C) {
-			output->data[idx] = (input->data[idx] - mean) * std_inv;
+		// immediate stats are used by backward in train mode
+		_tnn_bn_update_stats(
+		    batch_mean,
+		    batch_var,
+		    C_stats,
+		    momentum,
+		    running_mean,
+		    running_var,
+		    mean,
+		    ctx->std_inv
+		);
+		free(sums);
+	}
+	// padded lanes are 0 in input and grad, any finite scale keeps them 0
+	for (size_t c = C_stats; c < C; c++) {
+		mean[c] = 0.0f;
+		ctx->std_inv[c] = 1.0f;
+	}
+
+	// normalize
+	const float *std_inv = ctx->std_inv;
+#pragma omp parallel for schedule(static)
+	for (size_t r = 0; r < NHW; r++) {
+		const float *input_row = input->data + r * C;
+		float *output_row = output->data + r * C;
+		for (size_t c = 0; c < C; c++) {
+			output_row[c] = (input_row[c] - mean[c]) * std_inv[c];
 		}
 	}
+	free(mean);
 
 	output->requires_grad = input->requires_grad;
 	output->parents[0] = input;
@@ -237,6 +433,11 @@ tnn_tensor_t *tnn_bn(tnn_tensor_t *input, float momentum, bool test) {
 	output->backward = bn_backward;
 	output->context = ctx;
 	output->free_context = bn_free_context;
+	if (tnn_state.compact_bf16) {
+		ctx->x_norm_bf16 = _tnn_bn_encode_bf16(output->data, NHW * C);
+		_tnn_compact_output(output);
+	}
+	_tnn_compact_parent(output, 0);
 
 	return output;
 }
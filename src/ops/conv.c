@@ -5,90 +5,576 @@
 #include <memory.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include "../impl/backend.h"
+#include "../impl/compact.h"
+#include "../impl/conv.h"
+#include "../impl/int8.h"
+#include "../impl/layout.h"
 #include "../impl/malloc.h"
+#include "../impl/prepack.h"
+#include "../impl/quant.h"
+#include "../impl/rng.h"
+#include "../impl/state.h"
 
-typedef struct {
-	size_t in_channels;
-	size_t height;
-	size_t width;
-	size_t dim_out;
-	size_t kernel_size;
-	size_t stride;
-	size_t padding;
-} conv_context_t;
+// fixed number of pixel chunks for parallel loops
+#define CONV_NUM_CHUNKS 64
+// output channels sharing each input pixel load in the weight grad
+#define CONV_GRAD_CHANNELS 16
+// output pixels per gathered patch block of the im2col forward
+#define CONV_IM2COL_PIXELS 64
 
-static void conv_free_context(void *ctx) {
-	free(ctx);
+tnn_conv_shape_t _tnn_conv_shape(
+    const tnn_tensor_t *input,
+    size_t dim_out,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding
+) {
+	assert(input->num_dims >= 3);
+
+	tnn_conv_shape_t shape;
+	shape.batch = 1;
+	for (size_t i = 0; i < input->num_dims - 3; i++) {
+		shape.batch *= input->dims[i];
+	}
+
+	shape.h_in = input->dims[input->num_dims - 3];
+	shape.w_in = input->dims[input->num_dims - 2];
+	shape.c_in = input->dims[input->num_dims - 1];
+
+	// available space to slide: (h_in + 2*padding - kernel_size)
+	// this is the distance from first to last valid kernel position
+	// ---
+	// number of steps taken: distance / stride
+	// if stride=2, you only count every other position
+	// ---
+	// positions = steps + 1 (fencepost problem)
+	shape.h_out = (shape.h_in + 2 * padding - kernel_size) / stride + 1;
+	shape.w_out = (shape.w_in + 2 * padding - kernel_size) / stride + 1;
+	shape.c_out = dim_out;
+
+	shape.kernel_size = kernel_size;
+	shape.stride = stride;
+	shape.padding = padding;
+	shape.algo = TNN_CONV_ALGO_DIRECT;
+	return shape;
 }
 
-static void conv_backward(tnn_tensor_t *self) {
-	tnn_tensor_t *input = self->parents[0];
-	tnn_tensor_t *weight = self->parents[1];
+void _tnn_conv_output_dims(
+    const tnn_conv_shape_t *shape, const tnn_tensor_t *input, size_t *out_dims
+) {
+	size_t num_dims = input->num_dims;
+	memcpy(out_dims, input->dims, (num_dims - 3) * sizeof(size_t));
+	out_dims[num_dims - 3] = shape->h_out;
+	out_dims[num_dims - 2] = shape->w_out;
+	out_dims[num_dims - 1] = shape->c_out;
+}
 
-	assert(self->context != NULL);
-	conv_context_t *ctx = (conv_context_t *)self->context;
+tnn_tensor_t *_tnn_conv_weight(const tnn_conv_shape_t *shape) {
+	size_t k = shape->kernel_size;
 
-	size_t batch = 1;
-	for (size_t i = 0; i < input->num_dims - 3; i++) {
-		batch *= input->dims[i];
+	// weight dims: [out_channels, kernel_size, kernel_size, in_channels]
+	size_t weight_dims[4] = {shape->c_out, k, k, shape->c_in};
+	bool weight_created = false;
+	tnn_tensor_t *weight =
+	    tnn_alloc_or_get_state(weight_dims, 4, "conv", &weight_created);
+	_tnn_require_grad(weight);
+	if (weight_created) {
+		// uniform xavier init
+		size_t fan_in = k * k * shape->c_in;
+		size_t fan_out = k * k * shape->c_out;
+
+		float limit = sqrtf(6.0f / (fan_in + fan_out));
+
+		_tnn_fill_uniform(
+		    weight->data,
+		    tnn_size(weight),
+		    _tnn_state_stream("conv"),
+		    -limit,
+		    limit
+		);
 	}
 
-	size_t h_in = ctx->height;
-	size_t w_in = ctx->width;
-	size_t c_in = ctx->in_channels;
-	size_t c_out = ctx->dim_out;
-	size_t k = ctx->kernel_size;
-	size_t s = ctx->stride;
-	size_t p = ctx->padding;
+	return weight;
+}
 
-	size_t h_out = (h_in + 2 * p - k) / s + 1;
-	size_t w_out = (w_in + 2 * p - k) / s + 1;
+// 1x1 kernel over every pixel: a gemm over [pixels, c_in] @ weight^T
+static bool _is_pointwise(const tnn_conv_shape_t *shape) {
+	return shape->kernel_size == 1 && shape->stride == 1 && shape->padding == 0;
+}
 
-	// clang-format off
-	for (size_t b = 0; b < batch; b++) {
-	for (size_t i_out = 0; i_out < h_out; i_out++) {
-	for (size_t j_out = 0; j_out < w_out; j_out++) {
-	for (size_t c = 0; c < c_out; c++) {
-		float grad_val = tnn_grad_at(self, b, i_out, j_out, c);
+// blocks of output pixels gather their zero-padded input patches, laid out
+// like weight rows ([k, k, c_in]), then patches @ weight^T is one gemm
+static void _conv_forward_im2col(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    float *output,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t k = shape->kernel_size;
+	size_t hw_out = shape->h_out * shape->w_out;
+	size_t patch_len = k * k * c_in;
+	float *patches =
+	    tnn_safe_malloc(CONV_IM2COL_PIXELS * patch_len * sizeof(float));
+
+	for (size_t block_begin = pixel_begin; block_begin < pixel_end;
+	     block_begin += CONV_IM2COL_PIXELS) {
+		size_t block_end = block_begin + CONV_IM2COL_PIXELS;
+		if (block_end > pixel_end) {
+			block_end = pixel_end;
+		}
+
+		for (size_t pixel = block_begin; pixel < block_end; pixel++) {
+			size_t b = pixel / hw_out;
+			size_t i_out = pixel % hw_out / shape->w_out;
+			size_t j_out = pixel % shape->w_out;
+			float *patch = patches + (pixel - block_begin) * patch_len;
+
+			// clang-format off
+			for (size_t ki = 0; ki < k; ki++) {
+			for (size_t kj = 0; kj < k; kj++) {
+				int i_in = i_out * shape->stride + ki - shape->padding;
+				int j_in = j_out * shape->stride + kj - shape->padding;
+				float *tap = patch + (ki * k + kj) * c_in;
+				if (i_in < 0 || i_in >= (int)h_in ||
+				    j_in < 0 || j_in >= (int)w_in) {
+					memset(tap, 0, c_in * sizeof(float));
+					continue;
+				}
+				memcpy(
+				    tap,
+				    input + ((b * h_in + i_in) * w_in + j_in) * c_in,
+				    c_in * sizeof(float)
+				);
+			}
+			}
+			// clang-format on
+		}
+
+		_tnn_backend->sgemm(
+		    patches,
+		    weight, // [c_out, k * k * c_in]
+		    output + block_begin * shape->c_out,
+		    block_end - block_begin,
+		    patch_len,
+		    shape->c_out,
+		    false,
+		    true, // tpose weight
+		    false
+		);
+	}
+
+	free(patches);
+}
+
+void _tnn_conv_forward(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    float *output,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t c_out = shape->c_out;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+	size_t hw_out = shape->h_out * shape->w_out;
+
+	if (_is_pointwise(shape)) {
+		_tnn_backend->sgemm(
+		    input + pixel_begin * c_in,
+		    weight, // [c_out, c_in]
+		    output + pixel_begin * c_out,
+		    pixel_end - pixel_begin,
+		    c_in,
+		    c_out,
+		    false,
+		    true, // tpose weight
+		    false
+		);
+		return;
+	}
+	if (shape->algo == TNN_CONV_ALGO_IM2COL) {
+		_conv_forward_im2col(
+		    shape, input, weight, output, pixel_begin, pixel_end
+		);
+		return;
+	}
+
+	for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+		size_t b = pixel / hw_out;
+		size_t i_out = pixel % hw_out / shape->w_out;
+		size_t j_out = pixel % shape->w_out;
+		float *out_pixel = output + pixel * c_out;
+
+		for (size_t c = 0; c < c_out; c++) {
+			float sum = 0.0f;
 
+			// clang-format off
+			for (size_t ki = 0; ki < k; ki++) {
+			for (size_t kj = 0; kj < k; kj++) {
+				int i_in = i_out * s + ki - p;
+				int j_in = j_out * s + kj - p;
+
+				if (i_in >= 0 && i_in < (int)h_in && j_in >= 0 && j_in < (int)w_in) {
+					// in_channels are contiguous in both input and filter
+					const float *in_pixel =
+					    input + ((b * h_in + i_in) * w_in + j_in) * c_in;
+					const float *filter =
+					    weight + ((c * k + ki) * k + kj) * c_in;
+					sum += _tnn_backend->dot(in_pixel, filter, c_in);
+				}
+			}
+			}
+			// clang-format on
+
+			out_pixel[c] = sum;
+		}
+	}
+}
+
+void _tnn_conv_forward_parallel(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    float *output
+) {
+	// 1x1 runs as one gemm that parallelizes itself
+	size_t num_pixels = shape->batch * shape->h_out * shape->w_out;
+	size_t num_chunks =
+	    num_pixels < CONV_NUM_CHUNKS ? num_pixels : CONV_NUM_CHUNKS;
+	if (_is_pointwise(shape)) {
+		num_chunks = 1;
+	}
+#pragma omp parallel for schedule(static) if (num_chunks > 1)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		_tnn_conv_forward(
+		    shape,
+		    input,
+		    weight,
+		    output,
+		    num_pixels * chunk / num_chunks,
+		    num_pixels * (chunk + 1) / num_chunks
+		);
+	}
+}
+
+// input grad as a transposed conv, gathered per input pixel so pixels own
+// their grad: in_grad[pixel] += sum over taps of out_grad[o] @ weight[tap]
+static void _conv_input_grad(
+    const tnn_conv_shape_t *shape,
+    const float *weight,
+    const float *output_grad,
+    float *input_grad,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t c_out = shape->c_out;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+	size_t hw_in = h_in * w_in;
+
+	for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+		size_t b = pixel / hw_in;
+		size_t i_in = pixel % hw_in / w_in;
+		size_t j_in = pixel % w_in;
+		float *restrict in_grad_pixel = input_grad + pixel * c_in;
+
+		// clang-format off
 		for (size_t ki = 0; ki < k; ki++) {
 		for (size_t kj = 0; kj < k; kj++) {
-			int i_in = i_out * s + ki - p;
-			int j_in = j_out * s + kj - p;
+			// output pixel reading this input pixel at tap (ki, kj)
+			int i_strided = (int)(i_in + p) - (int)ki;
+			int j_strided = (int)(j_in + p) - (int)kj;
+			if (i_strided < 0 || i_strided % s != 0 ||
+			    j_strided < 0 || j_strided % s != 0) {
+				continue;
+			}
+			size_t i_out = i_strided / s;
+			size_t j_out = j_strided / s;
+			if (i_out >= shape->h_out || j_out >= shape->w_out) {
+				continue;
+			}
 
-			if (i_in >= 0 && i_in < (int)h_in && j_in >= 0 && j_in < (int)w_in) {
-				for (size_t c_i = 0; c_i < c_in; c_i++) {
-					if (input->requires_grad) {
-						float w_val = tnn_value_at(weight, c, ki, kj, c_i);
-						tnn_grad_at(input, b, i_in, j_in, c_i) += grad_val * w_val;
-					}
-
-					if (weight->requires_grad) {
-						float in_val = tnn_value_at(input, b, i_in, j_in, c_i);
-						tnn_grad_at(weight, c, ki, kj, c_i) += grad_val * in_val;
-					}
+			const float *out_grad_pixel = output_grad +
+			    ((b * shape->h_out + i_out) * shape->w_out + j_out) * c_out;
+			for (size_t c = 0; c < c_out; c++) {
+				float grad_val = out_grad_pixel[c];
+				if (grad_val == 0.0f) {
+					continue; // common after relu
 				}
+				const float *filter = weight + ((c * k + ki) * k + kj) * c_in;
+				_tnn_backend->axpy(in_grad_pixel, grad_val, filter, c_in);
 			}
 		}
 		}
+		// clang-format on
 	}
+}
+
+// weight grad of filter tap (ki, kj) for output channels [c_begin, c_end),
+// reduced over all output pixels of the batch
+static void _conv_weight_grad(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *output_grad,
+    float *weight_grad,
+    size_t ki,
+    size_t kj,
+    size_t c_begin,
+    size_t c_end
+) {
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t c_out = shape->c_out;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+
+	// clang-format off
+	for (size_t b = 0; b < shape->batch; b++) {
+	for (size_t i_out = 0; i_out < shape->h_out; i_out++) {
+		int i_in = i_out * s + ki - p;
+		if (i_in < 0 || i_in >= (int)h_in) {
+			continue;
+		}
+	for (size_t j_out = 0; j_out < shape->w_out; j_out++) {
+		int j_in = j_out * s + kj - p;
+		if (j_in < 0 || j_in >= (int)w_in) {
+			continue;
+		}
+
+		size_t pixel = (b * shape->h_out + i_out) * shape->w_out + j_out;
+		const float *out_grad_pixel = output_grad + pixel * c_out;
+		// loaded once for the whole channel block
+		const float *restrict in_pixel =
+		    input + ((b * h_in + i_in) * w_in + j_in) * c_in;
+		for (size_t c = c_begin; c < c_end; c++) {
+			float grad_val = out_grad_pixel[c];
+			if (grad_val == 0.0f) {
+				continue;
+			}
+			float *w_grad_tap = weight_grad + ((c * k + ki) * k + kj) * c_in;
+			_tnn_backend->axpy(w_grad_tap, grad_val, in_pixel, c_in);
+		}
 	}
 	}
 	}
 	// clang-format on
 }
 
-tnn_tensor_t *_tnn_conv(
+void _tnn_conv_backward(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    const float *output_grad,
+    float *input_grad,
+    float *weight_grad
+) {
+	if (_is_pointwise(shape)) {
+		size_t num_pixels = shape->batch * shape->h_in * shape->w_in;
+		if (input_grad != NULL) {
+			// input_grad += output_grad @ weight
+			_tnn_backend->sgemm(
+			    output_grad,
+			    weight,
+			    input_grad,
+			    num_pixels,
+			    shape->c_out,
+			    shape->c_in,
+			    false,
+			    false,
+			    true // accum
+			);
+		}
+		if (weight_grad != NULL) {
+			// weight_grad += output_grad^T @ input
+			_tnn_backend->sgemm(
+			    output_grad,
+			    input,
+			    weight_grad,
+			    shape->c_out,
+			    num_pixels,
+			    shape->c_in,
+			    true,
+			    false,
+			    true
+			);
+		}
+		return;
+	}
+
+	// both kernels write disjoint slices of their grad, no partials needed
+	if (input_grad != NULL) {
+		size_t num_pixels = shape->batch * shape->h_in * shape->w_in;
+		size_t num_chunks =
+		    num_pixels < CONV_NUM_CHUNKS ? num_pixels : CONV_NUM_CHUNKS;
+#pragma omp parallel for schedule(static)
+		for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+			_conv_input_grad(
+			    shape,
+			    weight,
+			    output_grad,
+			    input_grad,
+			    num_pixels * chunk / num_chunks,
+			    num_pixels * (chunk + 1) / num_chunks
+			);
+		}
+	}
+
+	if (weight_grad != NULL) {
+		size_t k = shape->kernel_size;
+		size_t num_blocks =
+		    (shape->c_out + CONV_GRAD_CHANNELS - 1) / CONV_GRAD_CHANNELS;
+		size_t num_items = k * k * num_blocks;
+#pragma omp parallel for schedule(static)
+		for (size_t item = 0; item < num_items; item++) {
+			size_t tap = item / num_blocks;
+			size_t c_begin = item % num_blocks * CONV_GRAD_CHANNELS;
+			size_t c_end = c_begin + CONV_GRAD_CHANNELS;
+			if (c_end > shape->c_out) {
+				c_end = shape->c_out;
+			}
+			_conv_weight_grad(
+			    shape,
+			    input,
+			    output_grad,
+			    weight_grad,
+			    tap / k,
+			    tap % k,
+			    c_begin,
+			    c_end
+			);
+		}
+	}
+}
+
+typedef struct {
+	tnn_conv_shape_t shape;
+	// blocked input: packed weight of the shape's channels, NULL otherwise
+	const float *weight_blocked;
+} conv_context_t;
+
+static void conv_free_context(void *ctx) {
+	free(ctx);
+}
+
+// copies weight [c_out, k, k, c_in] into (to_blocked) or adds it from
+// blocked, whose c_out and c_in are padded, padded rows and lanes are skipped
+static void _block_weight(
+    const tnn_tensor_t *weight, float *plain, float *blocked, bool to_blocked
+) {
+	size_t c_out = weight->dims[0];
+	size_t taps = weight->dims[1] * weight->dims[2];
+	size_t c_in = weight->dims[3];
+	size_t c_in_blocked = _tnn_blocked_dim(c_in);
+
+	for (size_t c = 0; c < c_out; c++) {
+		for (size_t tap = 0; tap < taps; tap++) {
+			float *row = plain + (c * taps + tap) * c_in;
+			float *blocked_row = blocked + (c * taps + tap) * c_in_blocked;
+			for (size_t ch = 0; ch < c_in; ch++) {
+				if (to_blocked) {
+					blocked_row[ch] = row[ch];
+				} else {
+					row[ch] += blocked_row[ch];
+				}
+			}
+		}
+	}
+}
+
+static size_t _blocked_weight_size(const tnn_tensor_t *weight) {
+	return _tnn_blocked_dim(weight->dims[0]) * weight->dims[1] *
+	       weight->dims[2] * _tnn_blocked_dim(weight->dims[3]);
+}
+
+static void _pack_blocked(const tnn_tensor_t *weight, float *packed) {
+	memset(packed, 0, _blocked_weight_size(weight) * sizeof(float));
+	_block_weight(weight, weight->data, packed, true);
+}
+
+const float *_tnn_conv_blocked_weight(tnn_tensor_t *weight) {
+	assert(weight->num_dims == 4);
+	return _tnn_packed(
+	    weight,
+	    TNN_PACK_CONV_BLOCKED,
+	    _blocked_weight_size(weight),
+	    _pack_blocked
+	);
+}
+
+static void conv_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+	tnn_tensor_t *weight = self->parents[1];
+
+	assert(self->context != NULL);
+	conv_context_t *ctx = (conv_context_t *)self->context;
+	const tnn_conv_shape_t *shape = &ctx->shape;
+
+	if (ctx->weight_blocked == NULL) {
+		_tnn_conv_backward(
+		    shape,
+		    input->data,
+		    weight->data,
+		    self->grad,
+		    input->requires_grad ? input->grad : NULL,
+		    weight->requires_grad ? weight->grad : NULL
+		);
+		return;
+	}
+
+	// padded lanes of the input grad come out 0, the weight grad is
+	// accumulated padded and scattered
+	float *weight_grad = NULL;
+	if (weight->requires_grad) {
+		weight_grad = calloc(
+		    shape->c_out * shape->kernel_size * shape->kernel_size *
+		        shape->c_in,
+		    sizeof(float)
+		);
+		assert(weight_grad != NULL && "calloc failed");
+	}
+	_tnn_conv_backward(
+	    shape,
+	    input->data,
+	    ctx->weight_blocked,
+	    self->grad,
+	    input->requires_grad ? input->grad : NULL,
+	    weight_grad
+	);
+	if (weight_grad != NULL) {
+		_block_weight(weight, weight->grad, weight_grad, false);
+		free(weight_grad);
+	}
+}
+
+// int8 inference path, see: tnn_quantize()
+static tnn_tensor_t *conv_q8_forward(
     tnn_tensor_t *input,
     size_t dim_out,
     size_t kernel_size,
     size_t stride,
-    size_t padding
+    size_t padding,
+    tnn_tensor_t *weight_q8
 ) {
-	assert(input->num_dims >= 3);
-
 	size_t batch = 1;
 	for (size_t i = 0; i < input->num_dims - 3; i++) {
 		batch *= input->dims[i];
@@ -98,35 +584,27 @@ tnn_tensor_t *_tnn_conv(
 	size_t w_in = input->dims[input->num_dims - 2];
 	size_t c_in = input->dims[input->num_dims - 1];
 
-	// available space to slide: (h_in + 2*padding - kernel_size)
-	// this is the distance from first to last valid kernel position
-	// ---
-	// number of steps taken: distance / stride
-	// if stride=2, you only count every other position
-	// ---
-	// positions = steps + 1 (fencepost problem)
 	size_t h_out = (h_in + 2 * padding - kernel_size) / stride + 1;
 	size_t w_out = (w_in + 2 * padding - kernel_size) / stride + 1;
 
-	// weight dims: [out_channels, kernel_size, kernel_size, in_channels]
-	size_t weight_dims[4] = {dim_out, kernel_size, kernel_size, c_in};
-	bool weight_created = false;
-	tnn_tensor_t *weight =
-	    tnn_alloc_or_get_state(weight_dims, 4, "conv", &weight_created);
-	weight->requires_grad = true;
-	if (weight_created) {
-		// uniform xavier init
-		size_t fan_in = kernel_size * kernel_size * c_in;
-		size_t fan_out = kernel_size * kernel_size * dim_out;
+	// weight_q8 rows are flattened [kernel_size, kernel_size, in_channels]
+	// filters of each output channel, padded to whole words
+	size_t row_len = kernel_size * kernel_size * c_in;
+	size_t row_words = _tnn_q8_row_words(row_len);
+	assert(weight_q8->dims[0] == dim_out && weight_q8->dims[1] == row_words);
+	tnn_tensor_t *scale = tnn_get_state("conv/scale");
+	assert(scale != NULL);
+	tnn_tensor_t *bias = tnn_get_state("conv/bias"); // see: tnn_fold_bn()
 
-		float limit = sqrtf(6.0f / (fan_in + fan_out));
+	// static input range from calibration, otherwise dynamic
+	size_t input_size = tnn_size(input);
+	tnn_tensor_t *act = tnn_get_state("conv/act");
+	float input_abs_max = act != NULL ? act->data[0]
+	                                  : _tnn_abs_max(input->data, input_size);
+	float input_scale = _tnn_q8_scale(input_abs_max);
 
-		size_t total_size = tnn_size(weight);
-		for (size_t i = 0; i < total_size; i++) {
-			float u = (float)rand() / (float)RAND_MAX;
-			weight->data[i] = u * 2.0f * limit - limit;
-		}
-	}
+	int8_t *input_q8 = tnn_safe_malloc(input_size);
+	_tnn_quantize_q8(input_q8, input->data, input_size, input_scale);
 
 	size_t output_dims[100];
 	if (input->num_dims > 100) {
@@ -140,54 +618,131 @@ tnn_tensor_t *_tnn_conv(
 
 	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
 
-	// forward pass
+	const int8_t *weight_rows = (const int8_t *)weight_q8->data;
+	size_t row_bytes = row_words * 4;
+
 	// clang-format off
-    for (size_t b = 0; b < batch; b++) {
-    for (size_t i = 0; i < h_out; i++) {
-    for (size_t j = 0; j < w_out; j++) {
-    for (size_t c = 0; c < dim_out; c++) {
-        float sum = 0.0f;
-
-        for (size_t ki = 0; ki < kernel_size; ki++) {
-        for (size_t kj = 0; kj < kernel_size; kj++) {
-            int i_in = i * stride + ki - padding;
-            int j_in = j * stride + kj - padding;
-
-            if (i_in >= 0 && i_in < (int)h_in && j_in >= 0 && j_in < (int)w_in) {
-                for (size_t c_in_idx = 0; c_in_idx < c_in; c_in_idx++) {
-					float in_val = tnn_value_at(input, b, i_in, j_in, c_in_idx);
-					float w_val = tnn_value_at(weight, c, ki, kj, c_in_idx);
-                    sum += in_val * w_val;
-                }
-            }
-        }
-        }
-
-		tnn_value_at(output, b, i, j, c) = sum;
-    }
-    }
-    }
+	for (size_t b = 0; b < batch; b++) {
+	for (size_t i = 0; i < h_out; i++) {
+	for (size_t j = 0; j < w_out; j++) {
+	for (size_t c = 0; c < dim_out; c++) {
+		const int8_t *filter = weight_rows + c * row_bytes;
+		int32_t acc = 0;
+
+		for (size_t ki = 0; ki < kernel_size; ki++) {
+		for (size_t kj = 0; kj < kernel_size; kj++) {
+			int i_in = i * stride + ki - padding;
+			int j_in = j * stride + kj - padding;
+
+			if (i_in >= 0 && i_in < (int)h_in && j_in >= 0 && j_in < (int)w_in) {
+				// in_channels are contiguous in both input and filter
+				const int8_t *pixel =
+				    input_q8 + ((b * h_in + i_in) * w_in + j_in) * c_in;
+				acc += _tnn_backend->dot_q8(
+				    pixel, filter + (ki * kernel_size + kj) * c_in, c_in
+				);
+			}
+		}
+		}
+
+		tnn_value_at(output, b, i, j, c) =
+		    (float)acc * input_scale * scale->data[c] +
+		    (bias != NULL ? bias->data[c] : 0.0f);
+	}
+	}
+	}
 	}
 	// clang-format on
 
+	free(input_q8);
+
+	// forward-only
+	output->parents[0] = input;
+	output->num_parents = 1;
+	output->requires_grad = false;
+	input->num_children++;
+
+	return output;
+}
+
+tnn_tensor_t *_tnn_conv(
+    tnn_tensor_t *input,
+    size_t dim_out,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding
+) {
+	assert(input->num_dims >= 3);
+	tnn_realize(input);
+
+	tnn_tensor_t *weight_q8 = tnn_get_state("conv/q8");
+	if (weight_q8 != NULL) {
+		assert(input->channels == 0 && "int8 conv expects plain input");
+		return conv_q8_forward(
+		    input, dim_out, kernel_size, stride, padding, weight_q8
+		);
+	}
+	if (tnn_state.calibrating) {
+		_tnn_calibrate_observe("conv", input);
+	}
+
+	// blocked input: the kernels run on padded channels, the weight keeps
+	// the plain ones
+	bool blocked = input->channels != 0;
 	conv_context_t *ctx = tnn_safe_malloc(sizeof(conv_context_t));
-	ctx->in_channels = c_in;
-	ctx->height = h_in;
-	ctx->width = w_in;
-	ctx->dim_out = dim_out;
-	ctx->kernel_size = kernel_size;
-	ctx->stride = stride;
-	ctx->padding = padding;
+	ctx->shape = _tnn_conv_shape(
+	    input,
+	    blocked ? _tnn_blocked_dim(dim_out) : dim_out,
+	    kernel_size,
+	    stride,
+	    padding
+	);
+	tnn_conv_shape_t *shape = &ctx->shape;
+
+	tnn_conv_shape_t weight_shape = *shape;
+	weight_shape.c_in = _tnn_channels(input);
+	weight_shape.c_out = dim_out;
+	tnn_tensor_t *weight = _tnn_conv_weight(&weight_shape);
+
+	// packed once per weight update, see: tnn_prepack()
+	ctx->weight_blocked = blocked ? _tnn_conv_blocked_weight(weight) : NULL;
+	const float *weight_data = blocked ? ctx->weight_blocked : weight->data;
+
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	_tnn_conv_output_dims(shape, input, output_dims);
+	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
+	output->channels = blocked ? dim_out : 0;
+
+	// forward pass
+	_tnn_conv_autotune(shape, input->data, weight_data);
+	_tnn_conv_forward_parallel(shape, input->data, weight_data, output->data);
+	size_t num_pixels = shape->batch * shape->h_out * shape->w_out;
+
+	// folded batch norm shift, see: tnn_fold_bn()
+	tnn_tensor_t *bias = tnn_get_state("conv/bias");
+	if (bias != NULL) {
+		for (size_t pixel = 0; pixel < num_pixels; pixel++) {
+			float *out_pixel = output->data + pixel * shape->c_out;
+			for (size_t c = 0; c < dim_out; c++) {
+				out_pixel[c] += bias->data[c];
+			}
+		}
+	}
 
 	output->parents[0] = input;
 	output->parents[1] = weight;
 	output->num_parents = 2;
 	output->requires_grad = true;
 	input->num_children++;
-	weight->num_children++;
+	_tnn_retain_state(weight);
 	output->backward = conv_backward;
 	output->context = ctx;
 	output->free_context = conv_free_context;
+	_tnn_compact_output(output);
 
 	return output;
 }
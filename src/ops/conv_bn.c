@@ -0,0 +1,342 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <math.h>
+#include <memory.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../impl/bn.h"
+#include "../impl/compact.h"
+#include "../impl/conv.h"
+#include "../impl/malloc.h"
+#include "../impl/state.h"
+
+// output pixels computed per tile, BN statistics are gathered from each tile
+// while it's still in cache
+#define CONV_BN_TILE_PIXELS 64
+
+typedef struct {
+	tnn_conv_shape_t shape;
+	bool test;
+	bool relu;
+	float *x_norm;  // [pixels, c_out], normalized conv output (pre skip/relu)
+	float *std_inv; // [c_out]
+	// see: tnn_compact_activations()
+	uint16_t *x_norm_bf16; // replaces x_norm if not NULL
+	uint32_t *relu_mask;   // output > 0 bits, NULL: output data is read
+} conv_bn_context_t;
+
+static void conv_bn_free_context(void *ctx) {
+	conv_bn_context_t *conv_bn_ctx = (conv_bn_context_t *)ctx;
+	free(conv_bn_ctx->x_norm);
+	free(conv_bn_ctx->std_inv);
+	free(conv_bn_ctx->x_norm_bf16);
+	free(conv_bn_ctx->relu_mask);
+	free(conv_bn_ctx);
+}
+
+static void conv_bn_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+	tnn_tensor_t *weight = self->parents[1];
+	tnn_tensor_t *skip = self->num_parents > 2 ? self->parents[2] : NULL;
+
+	assert(self->context != NULL);
+	conv_bn_context_t *ctx = (conv_bn_context_t *)self->context;
+	const tnn_conv_shape_t *shape = &ctx->shape;
+
+	size_t num_pixels = shape->batch * shape->h_out * shape->w_out;
+	size_t C = shape->c_out;
+	size_t total_size = num_pixels * C;
+
+	// relu, masked into a copy so self->grad stays dL/d(output)
+	float *grad = self->grad;
+	if (ctx->relu) {
+		grad = tnn_safe_malloc(total_size * sizeof(float));
+		for (size_t i = 0; i < total_size; i++) {
+			bool positive = ctx->relu_mask != NULL
+			                    ? _tnn_mask_get(ctx->relu_mask, i)
+			                    : self->data[i] > 0.0f;
+			grad[i] = positive ? self->grad[i] : 0.0f;
+		}
+	}
+
+	// residual add
+	if (skip != NULL && skip->requires_grad) {
+		for (size_t i = 0; i < total_size; i++) {
+			skip->grad[i] += grad[i];
+		}
+	}
+
+	if (!input->requires_grad && !weight->requires_grad) {
+		if (grad != self->grad) {
+			free(grad);
+		}
+		return;
+	}
+
+	// bn
+	float *x_norm = ctx->x_norm;
+	if (ctx->x_norm_bf16 != NULL) {
+		x_norm = _tnn_bn_decode_bf16(ctx->x_norm_bf16, total_size);
+	}
+	float *conv_grad = calloc(total_size, sizeof(float));
+	assert(conv_grad != NULL && "calloc failed");
+	_tnn_bn_input_grad(
+	    grad, x_norm, ctx->std_inv, ctx->test, num_pixels, C, conv_grad
+	);
+	if (x_norm != ctx->x_norm) {
+		free(x_norm);
+	}
+	if (grad != self->grad) {
+		free(grad);
+	}
+
+	// conv
+	_tnn_conv_backward(
+	    shape,
+	    input->data,
+	    weight->data,
+	    conv_grad,
+	    input->requires_grad ? input->grad : NULL,
+	    weight->requires_grad ? weight->grad : NULL
+	);
+
+	free(conv_grad);
+}
+
+// conv over a chunk of pixels, gathering shifted BN sums on the way:
+//   out_stats[c] = SUM{z - shift}, out_stats[C + c] = SUM{(z - shift)^2}
+// where shift is the chunk's first output pixel
+static void _conv_chunk(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    const float *weight,
+    float *z,
+    size_t pixel_begin,
+    size_t pixel_end,
+    double *out_stats // NULL: no stats (test mode)
+) {
+	size_t C = shape->c_out;
+	float *block = NULL;
+	if (out_stats != NULL) {
+		memset(out_stats, 0, 2 * C * sizeof(double));
+		block = tnn_safe_malloc(2 * C * sizeof(float));
+	}
+
+	for (size_t t0 = pixel_begin; t0 < pixel_end; t0 += CONV_BN_TILE_PIXELS) {
+		size_t t1 = t0 + CONV_BN_TILE_PIXELS;
+		if (t1 > pixel_end) {
+			t1 = pixel_end;
+		}
+
+		_tnn_conv_forward(shape, input, weight, z, t0, t1);
+		if (out_stats == NULL) {
+			continue;
+		}
+
+		// epilogue: tile statistics
+		const float *shift = z + pixel_begin * C;
+		float *restrict block_sum = block;
+		float *restrict block_sum_sq = block + C;
+		memset(block, 0, 2 * C * sizeof(float));
+		for (size_t pixel = t0; pixel < t1; pixel++) {
+			const float *z_row = z + pixel * C;
+			for (size_t c = 0; c < C; c++) {
+				float d = z_row[c] - shift[c];
+				block_sum[c] += d;
+				block_sum_sq[c] += d * d;
+			}
+		}
+		for (size_t c = 0; c < C; c++) {
+			out_stats[c] += block_sum[c];
+			out_stats[C + c] += block_sum_sq[c];
+		}
+	}
+
+	free(block);
+}
+
+tnn_tensor_t *
+_tnn_conv_bn(tnn_tensor_t *input, size_t dim_out, tnn_conv_bn_cfg_t cfg) {
+	assert(input != NULL);
+	assert(input->num_dims >= 4); // [..., H, W, C]
+	assert(cfg.momentum >= 0.0f && cfg.momentum <= 1.0f);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
+	if (cfg.skip != NULL) {
+		tnn_realize(cfg.skip);
+	}
+
+	// quantized or folded layers are inference-only, plain ops handle them
+	if (tnn_get_state("conv/q8") != NULL ||
+	    tnn_get_state("bn/folded") != NULL) {
+		tnn_tensor_t *output = _tnn_bn(
+		    _tnn_conv(
+		        input, dim_out, cfg.kernel_size, cfg.stride, cfg.padding
+		    ),
+		    cfg.momentum,
+		    cfg.test
+		);
+		if (cfg.skip != NULL) {
+			output = tnn_add(output, cfg.skip);
+		}
+		return cfg.relu ? tnn_relu(output) : output;
+	}
+
+	// same state as the unfused tnn_conv() -> tnn_bn() chain
+	tnn_conv_shape_t shape = _tnn_conv_shape(
+	    input, dim_out, cfg.kernel_size, cfg.stride, cfg.padding
+	);
+	tnn_tensor_t *weight = _tnn_conv_weight(&shape);
+	_tnn_conv_autotune(&shape, input->data, weight->data);
+	tnn_tensor_t *running_mean, *running_var;
+	_tnn_bn_running_stats(dim_out, &running_mean, &running_var);
+
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	_tnn_conv_output_dims(&shape, input, output_dims);
+	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
+
+	tnn_tensor_t *skip = cfg.skip;
+	if (skip != NULL) {
+		assert(skip->num_dims == output->num_dims);
+		assert(tnn_size(skip) == tnn_size(output));
+	}
+
+	size_t num_pixels = shape.batch * shape.h_out * shape.w_out;
+	size_t C = dim_out;
+
+	conv_bn_context_t *ctx = tnn_safe_malloc(sizeof(conv_bn_context_t));
+	ctx->shape = shape;
+	ctx->test = cfg.test;
+	ctx->relu = cfg.relu;
+	ctx->x_norm = tnn_safe_malloc(num_pixels * C * sizeof(float));
+	ctx->std_inv = tnn_safe_malloc(C * sizeof(float));
+	ctx->x_norm_bf16 = NULL;
+	ctx->relu_mask = NULL;
+
+	// pass 1: conv output tiles (into x_norm) with stats in the epilogue
+	size_t num_chunks =
+	    num_pixels < TNN_BN_NUM_CHUNKS ? num_pixels : TNN_BN_NUM_CHUNKS;
+	double *chunk_stats =
+	    cfg.test ? NULL
+	             : tnn_safe_malloc(num_chunks * 2 * C * sizeof(double));
+
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		_conv_chunk(
+		    &shape,
+		    input->data,
+		    weight->data,
+		    ctx->x_norm,
+		    num_pixels * chunk / num_chunks,
+		    num_pixels * (chunk + 1) / num_chunks,
+		    chunk_stats != NULL ? chunk_stats + chunk * 2 * C : NULL
+		);
+	}
+
+	float *mean = tnn_safe_malloc(C * sizeof(float));
+	if (cfg.test) {
+		_tnn_bn_frozen_stats(running_mean, running_var, C, mean, ctx->std_inv);
+	} else {
+		// merge chunk mean/M2 pairs in order (Chan et al.)
+		double *merged = calloc(3 * C, sizeof(double));
+		assert(merged != NULL && "calloc failed");
+		double *batch_mean = merged, *batch_var = merged + C;
+		double *m2 = merged + 2 * C;
+		size_t count = 0;
+
+		for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+			size_t pixel_begin = num_pixels * chunk / num_chunks;
+			size_t n = num_pixels * (chunk + 1) / num_chunks - pixel_begin;
+			const float *shift = ctx->x_norm + pixel_begin * C;
+			const double *sum = chunk_stats + chunk * 2 * C;
+			const double *sum_sq = sum + C;
+
+			for (size_t c = 0; c < C; c++) {
+				double chunk_mean = shift[c] + sum[c] / n;
+				double chunk_m2 = sum_sq[c] - sum[c] * sum[c] / n;
+				double delta = chunk_mean - batch_mean[c];
+				batch_mean[c] += delta * n / (count + n);
+				m2[c] += chunk_m2 + delta * delta * count * n / (count + n);
+			}
+			count += n;
+		}
+		for (size_t c = 0; c < C; c++) {
+			batch_var[c] = m2[c] / num_pixels;
+		}
+
+		_tnn_bn_update_stats(
+		    batch_mean,
+		    batch_var,
+		    C,
+		    cfg.momentum,
+		    running_mean,
+		    running_var,
+		    mean,
+		    ctx->std_inv
+		);
+		free(merged);
+		free(chunk_stats);
+	}
+
+	// pass 2: normalize (kept for backward), skip add and relu
+	const float *std_inv = ctx->std_inv;
+	const float *skip_data = skip != NULL ? skip->data : NULL;
+	bool relu = cfg.relu;
+#pragma omp parallel for schedule(static)
+	for (size_t pixel = 0; pixel < num_pixels; pixel++) {
+		float *x_norm_row = ctx->x_norm + pixel * C;
+		float *output_row = output->data + pixel * C;
+		for (size_t c = 0; c < C; c++) {
+			float v = (x_norm_row[c] - mean[c]) * std_inv[c];
+			x_norm_row[c] = v;
+			if (skip_data != NULL) {
+				v += skip_data[pixel * C + c];
+			}
+			output_row[c] = relu && v < 0.0f ? 0.0f : v;
+		}
+	}
+	free(mean);
+
+	output->parents[0] = input;
+	output->parents[1] = weight;
+	output->num_parents = 2;
+	input->num_children++;
+	_tnn_retain_state(weight);
+	if (skip != NULL) {
+		output->parents[2] = skip;
+		output->num_parents = 3;
+		skip->num_children++;
+	}
+	output->requires_grad = true;
+	output->backward = conv_bn_backward;
+	output->context = ctx;
+	output->free_context = conv_bn_free_context;
+
+	// compact forms for backward, the fp32 x_norm is dropped
+	if (tnn_state.compacting) {
+		size_t total_size = num_pixels * C;
+		if (relu) {
+			ctx->relu_mask = _tnn_mask_alloc(total_size);
+			_tnn_mask_positive(ctx->relu_mask, output->data, 0, total_size);
+		}
+		if (tnn_state.compact_bf16) {
+			ctx->x_norm_bf16 = _tnn_bn_encode_bf16(ctx->x_norm, total_size);
+			free(ctx->x_norm);
+			ctx->x_norm = NULL;
+		}
+		_tnn_compact_output(output);
+		if (skip != NULL) {
+			_tnn_compact_parent(output, 2);
+		}
+	}
+
+	return output;
+}
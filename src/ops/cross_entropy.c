@@ -5,41 +5,19 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "../impl/exp.h"
 #include "../impl/malloc.h"
 
-static void calc_softmax_parts(
-    float *out_max_logit,
-    float *out_sum_exp,
-    tnn_tensor_t *pred,
-    size_t i_batch,
-    size_t num_classes
-) {
-	// compute values for softmax
-	*out_max_logit = pred->data[i_batch * num_classes];
-	for (size_t i_logit = 1; i_logit < num_classes; i_logit++) {
-		float logit = pred->data[i_batch * num_classes + i_logit];
-		if (logit > *out_max_logit) {
-			*out_max_logit = logit;
-		}
-	}
-	*out_sum_exp = 0.0f;
-	for (size_t i_logit = 0; i_logit < num_classes; i_logit++) {
-		*out_sum_exp +=
-		    expf(pred->data[i_batch * num_classes + i_logit] - *out_max_logit);
-	}
-}
-
-static float softmax_from_parts(float logit, float max_logit, float sum_exp) {
-	return expf(logit - max_logit) / sum_exp;
-}
-
+// softmax is recomputed in backward as exp(logit - lse), one float per row
+// is kept instead of a [batch_size, num_classes] buffer
 typedef struct {
-	float *softmax; // [batch_size, num_classes]
+	float *lse;  // [batch_size], log-sum-exp of each row
+	bool sparse; // target holds class indices instead of one-hot rows
 } cross_entropy_context_t;
 
 static void cross_entropy_free_context(void *ctx) {
 	cross_entropy_context_t *ce_ctx = (cross_entropy_context_t *)ctx;
-	free(ce_ctx->softmax);
+	free(ce_ctx->lse);
 	free(ce_ctx);
 }
 
@@ -47,7 +25,6 @@ static void cross_entropy_backward(tnn_tensor_t *self) {
 	tnn_tensor_t *target = self->parents[0];
 	tnn_tensor_t *pred = self->parents[1];
 
-	assert(target->num_dims == 2);
 	assert(pred->num_dims == 2);
 	assert(self->context != NULL);
 
@@ -56,64 +33,78 @@ static void cross_entropy_backward(tnn_tensor_t *self) {
 	size_t batch_size = pred->dims[0];
 	size_t num_classes = pred->dims[1];
 
+	if (!pred->requires_grad) {
+		return;
+	}
+
 	// pred->grad = (softmax(pred) - target) / batch_size
-	if (pred->requires_grad) {
-		for (size_t i = 0; i < batch_size; i++) {
+	float scale = self->grad[0] / (float)batch_size;
+#pragma omp parallel for schedule(static)
+	for (size_t i = 0; i < batch_size; i++) {
+		const float *logits = pred->data + i * num_classes;
+		float *grad = pred->grad + i * num_classes;
+		float lse = ctx->lse[i];
+
+		if (ctx->sparse) {
+			for (size_t j = 0; j < num_classes; j++) {
+				grad[j] += scale * _tnn_expf(logits[j] - lse);
+			}
+			grad[(size_t)target->data[i]] -= scale;
+		} else {
+			const float *target_row = target->data + i * num_classes;
 			for (size_t j = 0; j < num_classes; j++) {
-				size_t idx = i * num_classes + j;
-				float softmax_val = ctx->softmax[idx];
-				float target_val = target->data[idx];
-				pred->grad[idx] += self->grad[0] * (softmax_val - target_val) /
-				                   (float)batch_size;
+				float softmax_val = _tnn_expf(logits[j] - lse);
+				grad[j] += scale * (softmax_val - target_row[j]);
 			}
 		}
 	}
 }
 
-tnn_tensor_t *tnn_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target) {
-	assert(target->num_dims == 2 && "target must be 2D [batch, num_classes]");
-	assert(pred->num_dims == 2 && "pred must be 2D [batch, num_classes]");
+static tnn_tensor_t *
+_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target, bool sparse) {
+	tnn_realize(pred);
+	tnn_realize(target);
 
 	size_t batch_size = pred->dims[0];
 	size_t num_classes = pred->dims[1];
 
-	assert(target->dims[0] == batch_size);
-	assert(target->dims[1] == num_classes);
-
 	// allocate scalar output
 	tnn_tensor_t *output = tnn_alloc(NULL, 0);
 	output->requires_grad = pred->requires_grad;
 
-	// allocate context for storing softmax values
-	cross_entropy_context_t *ctx;
-	if (output->requires_grad) {
-		ctx = tnn_safe_malloc(sizeof(cross_entropy_context_t));
-		ctx->softmax =
-		    tnn_safe_malloc(batch_size * num_classes * sizeof(float));
-	}
-
-	float total_loss = 0.0f;
+	float *lse = tnn_safe_malloc(batch_size * sizeof(float));
+	float *row_loss = tnn_safe_malloc(batch_size * sizeof(float));
 
+	// -log(softmax(pred)[j]) = lse - pred[j]
+#pragma omp parallel for schedule(static)
 	for (size_t i = 0; i < batch_size; i++) {
-		float max_logit, sum_exp;
-		calc_softmax_parts(&max_logit, &sum_exp, pred, i, num_classes);
-
-		// compute cross entropy: -sum(target * log(softmax(pred)))
-		for (size_t j = 0; j < num_classes; j++) {
-			size_t idx = i * num_classes + j;
-			float softmax_val =
-			    softmax_from_parts(pred->data[idx], max_logit, sum_exp);
-			if (output->requires_grad) {
-				ctx->softmax[idx] = softmax_val;
-			}
-			float target_val = target->data[idx];
-
-			if (target_val > 0.0f) {
-				total_loss -= target_val * logf(softmax_val);
+		const float *logits = pred->data + i * num_classes;
+		lse[i] = _tnn_log_sum_exp(logits, num_classes);
+
+		if (sparse) {
+			float label = target->data[i];
+			assert(label >= 0.0f && label < (float)num_classes);
+			row_loss[i] = lse[i] - logits[(size_t)label];
+		} else {
+			// -sum(target * log(softmax(pred)))
+			const float *target_row = target->data + i * num_classes;
+			float loss = 0.0f;
+			for (size_t j = 0; j < num_classes; j++) {
+				if (target_row[j] > 0.0f) {
+					loss += target_row[j] * (lse[i] - logits[j]);
+				}
 			}
+			row_loss[i] = loss;
 		}
 	}
 
+	// summed in order, independent of thread count
+	float total_loss = 0.0f;
+	for (size_t i = 0; i < batch_size; i++) {
+		total_loss += row_loss[i];
+	}
+	free(row_loss);
+
 	output->data[0] = total_loss / (float)batch_size;
 
 	output->parents[0] = target;
@@ -122,10 +113,36 @@ tnn_tensor_t *tnn_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target) {
 	pred->num_children++;
 	target->num_children++;
 	if (output->requires_grad) {
+		cross_entropy_context_t *ctx =
+		    tnn_safe_malloc(sizeof(cross_entropy_context_t));
+		ctx->lse = lse;
+		ctx->sparse = sparse;
 		output->backward = cross_entropy_backward;
 		output->context = ctx;
 		output->free_context = cross_entropy_free_context;
+	} else {
+		free(lse);
 	}
 
 	return output;
 }
+
+tnn_tensor_t *tnn_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target) {
+	assert(target->num_dims == 2 && "target must be 2D [batch, num_classes]");
+	assert(pred->num_dims == 2 && "pred must be 2D [batch, num_classes]");
+
+	assert(target->dims[0] == pred->dims[0]);
+	assert(target->dims[1] == pred->dims[1]);
+
+	return _cross_entropy(pred, target, false);
+}
+
+tnn_tensor_t *
+tnn_sparse_cross_entropy(tnn_tensor_t *pred, tnn_tensor_t *target) {
+	assert(target->num_dims == 1 && "target must be 1D [batch]");
+	assert(pred->num_dims == 2 && "pred must be 2D [batch, num_classes]");
+
+	assert(target->dims[0] == pred->dims[0]);
+
+	return _cross_entropy(pred, target, true);
+}
@@ -0,0 +1,416 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../impl/compact.h"
+#include "../impl/conv.h"
+#include "../impl/malloc.h"
+#include "../impl/rng.h"
+#include "../impl/state.h"
+
+// fixed number of pixel chunks for parallel loops
+#define GROUP_CONV_NUM_CHUNKS 64
+// depthwise channels per weight grad work item
+#define DEPTHWISE_GRAD_CHANNELS 64
+
+// weight dims: [kernel_size, kernel_size, c_in / groups, c_out]
+// - output channels are the innermost (SIMD) dim, each group reads its own
+//   slice of c_in and writes its own slice of c_out
+// - depthwise (groups == c_in == c_out) is [kernel_size, kernel_size, 1, c]
+typedef struct {
+	tnn_conv_shape_t shape;
+	size_t groups;
+} group_conv_context_t;
+
+static bool _is_depthwise(const group_conv_context_t *ctx) {
+	return ctx->groups == ctx->shape.c_in && ctx->groups == ctx->shape.c_out;
+}
+
+// output pixels [pixel_begin, pixel_end)
+static void _group_conv_forward(
+    const group_conv_context_t *ctx,
+    const float *input,
+    const float *weight,
+    float *output,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	const tnn_conv_shape_t *shape = &ctx->shape;
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t c_out = shape->c_out;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+	size_t c_in_group = c_in / ctx->groups;
+	size_t c_out_group = c_out / ctx->groups;
+	size_t hw_out = shape->h_out * shape->w_out;
+	bool depthwise = _is_depthwise(ctx);
+
+	for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+		size_t b = pixel / hw_out;
+		size_t i_out = pixel % hw_out / shape->w_out;
+		size_t j_out = pixel % shape->w_out;
+		float *restrict out_pixel = output + pixel * c_out;
+		memset(out_pixel, 0, c_out * sizeof(float));
+
+		// clang-format off
+		for (size_t ki = 0; ki < k; ki++) {
+		for (size_t kj = 0; kj < k; kj++) {
+			int i_in = i_out * s + ki - p;
+			int j_in = j_out * s + kj - p;
+			if (i_in < 0 || i_in >= (int)h_in ||
+			    j_in < 0 || j_in >= (int)w_in) {
+				continue;
+			}
+
+			const float *restrict in_pixel =
+			    input + ((b * h_in + i_in) * w_in + j_in) * c_in;
+			const float *tap = weight + (ki * k + kj) * c_in_group * c_out;
+
+			if (depthwise) {
+				const float *restrict filter = tap;
+				for (size_t c = 0; c < c_out; c++) {
+					out_pixel[c] += in_pixel[c] * filter[c];
+				}
+				continue;
+			}
+
+			for (size_t g = 0; g < ctx->groups; g++) {
+				float *restrict out_group = out_pixel + g * c_out_group;
+				for (size_t c_i = 0; c_i < c_in_group; c_i++) {
+					float a = in_pixel[g * c_in_group + c_i];
+					const float *restrict filter =
+					    tap + c_i * c_out + g * c_out_group;
+					for (size_t c = 0; c < c_out_group; c++) {
+						out_group[c] += a * filter[c];
+					}
+				}
+			}
+		}
+		}
+		// clang-format on
+	}
+}
+
+// input grad as a transposed conv, gathered per input pixel, see:
+// _tnn_conv_backward()
+static void _group_conv_input_grad(
+    const group_conv_context_t *ctx,
+    const float *weight,
+    const float *output_grad,
+    float *input_grad,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	const tnn_conv_shape_t *shape = &ctx->shape;
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t c_out = shape->c_out;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+	size_t c_in_group = c_in / ctx->groups;
+	size_t c_out_group = c_out / ctx->groups;
+	size_t hw_in = h_in * w_in;
+	bool depthwise = _is_depthwise(ctx);
+
+	for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+		size_t b = pixel / hw_in;
+		size_t i_in = pixel % hw_in / w_in;
+		size_t j_in = pixel % w_in;
+		float *restrict in_grad_pixel = input_grad + pixel * c_in;
+
+		// clang-format off
+		for (size_t ki = 0; ki < k; ki++) {
+		for (size_t kj = 0; kj < k; kj++) {
+			// output pixel reading this input pixel at tap (ki, kj)
+			int i_strided = (int)(i_in + p) - (int)ki;
+			int j_strided = (int)(j_in + p) - (int)kj;
+			if (i_strided < 0 || i_strided % s != 0 ||
+			    j_strided < 0 || j_strided % s != 0) {
+				continue;
+			}
+			size_t i_out = i_strided / s;
+			size_t j_out = j_strided / s;
+			if (i_out >= shape->h_out || j_out >= shape->w_out) {
+				continue;
+			}
+
+			const float *restrict out_grad_pixel = output_grad +
+			    ((b * shape->h_out + i_out) * shape->w_out + j_out) * c_out;
+			const float *tap = weight + (ki * k + kj) * c_in_group * c_out;
+
+			if (depthwise) {
+				const float *restrict filter = tap;
+				for (size_t c = 0; c < c_in; c++) {
+					in_grad_pixel[c] += out_grad_pixel[c] * filter[c];
+				}
+				continue;
+			}
+
+			for (size_t g = 0; g < ctx->groups; g++) {
+				const float *restrict out_grad_group =
+				    out_grad_pixel + g * c_out_group;
+				for (size_t c_i = 0; c_i < c_in_group; c_i++) {
+					const float *restrict filter =
+					    tap + c_i * c_out + g * c_out_group;
+					float sum = 0.0f;
+					for (size_t c = 0; c < c_out_group; c++) {
+						sum += out_grad_group[c] * filter[c];
+					}
+					in_grad_pixel[g * c_in_group + c_i] += sum;
+				}
+			}
+		}
+		}
+		// clang-format on
+	}
+}
+
+// weight grad of filter tap (ki, kj) for output channels [c_begin, c_end),
+// reduced over all output pixels of the batch
+// - depthwise: any channel range
+// - otherwise: whole groups
+static void _group_conv_weight_grad(
+    const group_conv_context_t *ctx,
+    const float *input,
+    const float *output_grad,
+    float *weight_grad,
+    size_t ki,
+    size_t kj,
+    size_t c_begin,
+    size_t c_end
+) {
+	const tnn_conv_shape_t *shape = &ctx->shape;
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c_in = shape->c_in;
+	size_t c_out = shape->c_out;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+	size_t c_in_group = c_in / ctx->groups;
+	size_t c_out_group = c_out / ctx->groups;
+	bool depthwise = _is_depthwise(ctx);
+	float *tap_grad = weight_grad + (ki * k + kj) * c_in_group * c_out;
+
+	// clang-format off
+	for (size_t b = 0; b < shape->batch; b++) {
+	for (size_t i_out = 0; i_out < shape->h_out; i_out++) {
+		int i_in = i_out * s + ki - p;
+		if (i_in < 0 || i_in >= (int)h_in) {
+			continue;
+		}
+	for (size_t j_out = 0; j_out < shape->w_out; j_out++) {
+		int j_in = j_out * s + kj - p;
+		if (j_in < 0 || j_in >= (int)w_in) {
+			continue;
+		}
+
+		size_t pixel = (b * shape->h_out + i_out) * shape->w_out + j_out;
+		const float *restrict out_grad_pixel = output_grad + pixel * c_out;
+		const float *restrict in_pixel =
+		    input + ((b * h_in + i_in) * w_in + j_in) * c_in;
+
+		if (depthwise) {
+			float *restrict filter_grad = tap_grad;
+			for (size_t c = c_begin; c < c_end; c++) {
+				filter_grad[c] += in_pixel[c] * out_grad_pixel[c];
+			}
+			continue;
+		}
+
+		for (size_t g = c_begin / c_out_group; g < c_end / c_out_group; g++) {
+			const float *restrict out_grad_group =
+			    out_grad_pixel + g * c_out_group;
+			for (size_t c_i = 0; c_i < c_in_group; c_i++) {
+				float a = in_pixel[g * c_in_group + c_i];
+				if (a == 0.0f) {
+					continue; // common after relu
+				}
+				float *restrict filter_grad =
+				    tap_grad + c_i * c_out + g * c_out_group;
+				for (size_t c = 0; c < c_out_group; c++) {
+					filter_grad[c] += a * out_grad_group[c];
+				}
+			}
+		}
+	}
+	}
+	}
+	// clang-format on
+}
+
+static void group_conv_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+	tnn_tensor_t *weight = self->parents[1];
+
+	assert(self->context != NULL);
+	group_conv_context_t *ctx = (group_conv_context_t *)self->context;
+	const tnn_conv_shape_t *shape = &ctx->shape;
+
+	// every work item owns a disjoint slice of its grad
+	if (input->requires_grad) {
+		size_t num_pixels = shape->batch * shape->h_in * shape->w_in;
+		size_t num_chunks = num_pixels < GROUP_CONV_NUM_CHUNKS
+		                        ? num_pixels
+		                        : GROUP_CONV_NUM_CHUNKS;
+#pragma omp parallel for schedule(static)
+		for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+			_group_conv_input_grad(
+			    ctx,
+			    weight->data,
+			    self->grad,
+			    input->grad,
+			    num_pixels * chunk / num_chunks,
+			    num_pixels * (chunk + 1) / num_chunks
+			);
+		}
+	}
+
+	if (weight->requires_grad) {
+		// blocks of channels (depthwise) or whole groups per filter tap
+		size_t k = shape->kernel_size;
+		size_t block = _is_depthwise(ctx) ? DEPTHWISE_GRAD_CHANNELS
+		                                  : shape->c_out / ctx->groups;
+		size_t num_blocks = (shape->c_out + block - 1) / block;
+		size_t num_items = k * k * num_blocks;
+#pragma omp parallel for schedule(static)
+		for (size_t item = 0; item < num_items; item++) {
+			size_t tap = item / num_blocks;
+			size_t c_begin = item % num_blocks * block;
+			size_t c_end = c_begin + block;
+			if (c_end > shape->c_out) {
+				c_end = shape->c_out;
+			}
+			_group_conv_weight_grad(
+			    ctx,
+			    input->data,
+			    self->grad,
+			    weight->grad,
+			    tap / k,
+			    tap % k,
+			    c_begin,
+			    c_end
+			);
+		}
+	}
+}
+
+static tnn_tensor_t *_group_conv(
+    tnn_tensor_t *input,
+    const char *key,
+    size_t dim_out,
+    size_t groups,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding
+) {
+	assert(input->num_dims >= 3);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
+
+	group_conv_context_t *ctx = tnn_safe_malloc(sizeof(group_conv_context_t));
+	ctx->shape = _tnn_conv_shape(input, dim_out, kernel_size, stride, padding);
+	ctx->groups = groups;
+	const tnn_conv_shape_t *shape = &ctx->shape;
+	assert(groups > 0);
+	assert(shape->c_in % groups == 0 && "in channels must divide into groups");
+	assert(dim_out % groups == 0 && "out channels must divide into groups");
+
+	size_t k = kernel_size;
+	size_t c_in_group = shape->c_in / groups;
+	size_t weight_dims[4] = {k, k, c_in_group, dim_out};
+	bool weight_created = false;
+	tnn_tensor_t *weight =
+	    tnn_alloc_or_get_state(weight_dims, 4, key, &weight_created);
+	_tnn_require_grad(weight);
+	if (weight_created) {
+		// uniform xavier init, fans are per group
+		size_t fan_in = k * k * c_in_group;
+		size_t fan_out = k * k * (dim_out / groups);
+
+		float limit = sqrtf(6.0f / (fan_in + fan_out));
+
+		_tnn_fill_uniform(
+		    weight->data,
+		    tnn_size(weight),
+		    _tnn_state_stream(key),
+		    -limit,
+		    limit
+		);
+	}
+
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	_tnn_conv_output_dims(shape, input, output_dims);
+	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
+
+	size_t num_pixels = shape->batch * shape->h_out * shape->w_out;
+	size_t num_chunks =
+	    num_pixels < GROUP_CONV_NUM_CHUNKS ? num_pixels : GROUP_CONV_NUM_CHUNKS;
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		_group_conv_forward(
+		    ctx,
+		    input->data,
+		    weight->data,
+		    output->data,
+		    num_pixels * chunk / num_chunks,
+		    num_pixels * (chunk + 1) / num_chunks
+		);
+	}
+
+	output->parents[0] = input;
+	output->parents[1] = weight;
+	output->num_parents = 2;
+	output->requires_grad = true;
+	input->num_children++;
+	_tnn_retain_state(weight);
+	output->backward = group_conv_backward;
+	output->context = ctx;
+	output->free_context = free;
+	_tnn_compact_output(output);
+
+	return output;
+}
+
+tnn_tensor_t *_tnn_group_conv(
+    tnn_tensor_t *input,
+    size_t dim_out,
+    size_t groups,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding
+) {
+	return _group_conv(
+	    input, "group_conv", dim_out, groups, kernel_size, stride, padding
+	);
+}
+
+tnn_tensor_t *_tnn_depthwise_conv(
+    tnn_tensor_t *input, size_t kernel_size, size_t stride, size_t padding
+) {
+	assert(input->num_dims >= 3);
+	size_t channels = input->dims[input->num_dims - 1];
+	return _group_conv(
+	    input,
+	    "depthwise_conv",
+	    channels,
+	    channels,
+	    kernel_size,
+	    stride,
+	    padding
+	);
+}
@@ -0,0 +1,100 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../impl/compact.h"
+#include "../impl/layout.h"
+
+// rows of src_stride floats to rows of dst_stride floats, zero-filling tails
+static void _copy_rows(
+    float *dst,
+    size_t dst_stride,
+    const float *src,
+    size_t src_stride,
+    size_t num_rows,
+    size_t channels
+) {
+#pragma omp parallel for schedule(static)
+	for (size_t r = 0; r < num_rows; r++) {
+		float *dst_row = dst + r * dst_stride;
+		memcpy(dst_row, src + r * src_stride, channels * sizeof(float));
+		memset(dst_row + channels, 0, (dst_stride - channels) * sizeof(float));
+	}
+}
+
+// input->grad += self->grad over the channels that carry data
+static void layout_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+
+	if (!input->requires_grad) {
+		return;
+	}
+
+	size_t channels = _tnn_channels(self);
+	size_t self_stride = self->dims[self->num_dims - 1];
+	size_t input_stride = input->dims[input->num_dims - 1];
+	size_t num_rows = tnn_size(self) / self_stride;
+#pragma omp parallel for schedule(static)
+	for (size_t r = 0; r < num_rows; r++) {
+		const float *grad_row = self->grad + r * self_stride;
+		float *input_grad_row = input->grad + r * input_stride;
+		for (size_t c = 0; c < channels; c++) {
+			input_grad_row[c] += grad_row[c];
+		}
+	}
+}
+
+static tnn_tensor_t *
+_convert(tnn_tensor_t *input, size_t last_dim, size_t channels) {
+	size_t dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	memcpy(dims, input->dims, input->num_dims * sizeof(size_t));
+	dims[input->num_dims - 1] = last_dim;
+	tnn_tensor_t *output = tnn_alloc(dims, input->num_dims);
+	output->channels = channels;
+
+	size_t input_stride = input->dims[input->num_dims - 1];
+	_copy_rows(
+	    output->data,
+	    last_dim,
+	    input->data,
+	    input_stride,
+	    tnn_size(input) / input_stride,
+	    _tnn_channels(input)
+	);
+
+	output->requires_grad = input->requires_grad;
+	output->parents[0] = input;
+	output->num_parents = 1;
+	input->num_children++;
+	output->backward = layout_backward;
+	_tnn_compact_output(output);
+	_tnn_compact_parent(output, 0);
+
+	return output;
+}
+
+tnn_tensor_t *tnn_to_blocked(tnn_tensor_t *input) {
+	assert(input != NULL);
+	assert(input->num_dims >= 1);
+	assert(input->channels == 0 && "input is already blocked");
+	tnn_realize(input);
+
+	size_t channels = input->dims[input->num_dims - 1];
+	return _convert(input, _tnn_blocked_dim(channels), channels);
+}
+
+tnn_tensor_t *tnn_from_blocked(tnn_tensor_t *input) {
+	assert(input != NULL);
+	assert(input->channels != 0 && "input is not blocked");
+	tnn_realize(input);
+
+	return _convert(input, input->channels, 0);
+}
@@ -0,0 +1,239 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <memory.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "../impl/backend.h"
+#include "../impl/compact.h"
+#include "../impl/linear.h"
+#include "../impl/malloc.h"
+#include "../impl/quant.h"
+#include "../impl/state.h"
+
+// batch rows per forward sgemm call, each tile gets its bias and activation
+// while still in cache
+#define LINEAR_TILE_ROWS 4
+
+// output columns per backward block, relu mask and bias grad in one pass
+#define LINEAR_BLOCK_COLS 64
+
+typedef struct {
+	tnn_act_t act;
+} linear_context_t;
+
+static void linear_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+	tnn_tensor_t *weight = self->parents[1];
+	tnn_tensor_t *bias = self->parents[2];
+
+	assert(self->context != NULL);
+	linear_context_t *ctx = (linear_context_t *)self->context;
+
+	size_t dim_in = weight->dims[0];
+	size_t dim_out = weight->dims[1];
+	size_t dim_batch = tnn_size(input) / dim_in;
+
+	// relu, masked into a copy so self->grad stays dL/d(output)
+	// the output is the mask: output > 0 <=> pre-activation > 0
+	bool relu = ctx->act == TNN_ACT_RELU;
+	float *grad = self->grad;
+	if (relu) {
+		grad = tnn_safe_malloc(dim_batch * dim_out * sizeof(float));
+	}
+
+	// one pass over column blocks masks the grad and sums its rows into
+	// bias->grad, the backend sgemm has no strides to take an implicit
+	// row of ones alongside the weight grad
+	if (relu || bias->requires_grad) {
+		size_t num_blocks =
+		    (dim_out + LINEAR_BLOCK_COLS - 1) / LINEAR_BLOCK_COLS;
+#pragma omp parallel for schedule(static)
+		for (size_t block = 0; block < num_blocks; block++) {
+			size_t col_begin = block * LINEAR_BLOCK_COLS;
+			size_t col_end = col_begin + LINEAR_BLOCK_COLS;
+			if (col_end > dim_out) {
+				col_end = dim_out;
+			}
+			// seeded with bias->grad, same sum order as tnn_bias()
+			float sum[LINEAR_BLOCK_COLS] = {0};
+			if (bias->requires_grad) {
+				memcpy(
+				    sum,
+				    bias->grad + col_begin,
+				    (col_end - col_begin) * sizeof(float)
+				);
+			}
+
+			for (size_t i_batch = 0; i_batch < dim_batch; i_batch++) {
+				size_t row = i_batch * dim_out;
+				for (size_t i_out = col_begin; i_out < col_end; i_out++) {
+					float g = self->grad[row + i_out];
+					if (relu) {
+						g = self->data[row + i_out] > 0.0f ? g : 0.0f;
+						grad[row + i_out] = g;
+					}
+					sum[i_out - col_begin] += g;
+				}
+			}
+
+			if (bias->requires_grad) {
+				memcpy(
+				    bias->grad + col_begin,
+				    sum,
+				    (col_end - col_begin) * sizeof(float)
+				);
+			}
+		}
+	}
+
+	// input->grad += grad @ weight^T
+	if (input->requires_grad) {
+		_tnn_backend->sgemm(
+		    grad,
+		    weight->data,
+		    input->grad,
+		    dim_batch,
+		    dim_out,
+		    dim_in,
+		    false,
+		    true, // tpose weight
+		    true  // accum into input->grad
+		);
+	}
+
+	// weight->grad += input^T @ grad
+	if (weight->requires_grad) {
+		_tnn_backend->sgemm(
+		    input->data,
+		    grad,
+		    weight->grad,
+		    dim_in,
+		    dim_batch,
+		    dim_out,
+		    true,
+		    false,
+		    true
+		);
+	}
+
+	if (grad != self->grad) {
+		free(grad);
+	}
+}
+
+// output rows [row_begin, row_end) = act(input @ weight + bias)
+static void _linear_tile(
+    const float *input,
+    const float *weight,
+    const float *bias,
+    float *output,
+    size_t dim_in,
+    size_t dim_out,
+    size_t row_begin,
+    size_t row_end,
+    tnn_act_t act
+) {
+	// prologue: bias, the gemm accumulates onto it
+	for (size_t i_batch = row_begin; i_batch < row_end; i_batch++) {
+		memcpy(output + i_batch * dim_out, bias, dim_out * sizeof(float));
+	}
+
+	_tnn_backend->sgemm(
+	    input + row_begin * dim_in,
+	    weight,
+	    output + row_begin * dim_out,
+	    row_end - row_begin,
+	    dim_in,
+	    dim_out,
+	    false,
+	    false,
+	    true // accum onto the bias
+	);
+
+	// epilogue: activation
+	if (act == TNN_ACT_RELU) {
+		for (size_t i = row_begin * dim_out; i < row_end * dim_out; i++) {
+			output[i] = output[i] > 0.0f ? output[i] : 0.0f;
+		}
+	}
+}
+
+tnn_tensor_t *_tnn_linear(tnn_tensor_t *input, size_t dim_out, tnn_act_t act) {
+	assert(input != NULL);
+	assert(input->num_dims >= 2);
+	assert(act == TNN_ACT_NONE || act == TNN_ACT_RELU);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
+
+	// quantized layers are inference-only, plain ops handle them
+	if (tnn_get_state("proj/q8") != NULL) {
+		tnn_tensor_t *output = tnn_bias(tnn_proj(input, dim_out));
+		return act == TNN_ACT_RELU ? tnn_relu(output) : output;
+	}
+	if (tnn_state.calibrating) {
+		_tnn_calibrate_observe("proj", input);
+	}
+
+	size_t dim_batch = 1;
+	for (size_t i = 0; i < input->num_dims - 1; i++) {
+		dim_batch *= input->dims[i];
+	}
+	size_t dim_in = input->dims[input->num_dims - 1];
+
+	// same state as the unfused tnn_proj() -> tnn_bias() chain
+	tnn_tensor_t *weight = _tnn_proj_weight(dim_in, dim_out);
+	tnn_tensor_t *bias = _tnn_bias_param(dim_out);
+
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	memcpy(output_dims, input->dims, (input->num_dims - 1) * sizeof(size_t));
+	output_dims[input->num_dims - 1] = dim_out;
+	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
+
+	size_t num_tiles = (dim_batch + LINEAR_TILE_ROWS - 1) / LINEAR_TILE_ROWS;
+#pragma omp parallel for schedule(static)
+	for (size_t tile = 0; tile < num_tiles; tile++) {
+		size_t row_begin = tile * LINEAR_TILE_ROWS;
+		size_t row_end = row_begin + LINEAR_TILE_ROWS;
+		if (row_end > dim_batch) {
+			row_end = dim_batch;
+		}
+		_linear_tile(
+		    input->data,
+		    weight->data,
+		    bias->data,
+		    output->data,
+		    dim_in,
+		    dim_out,
+		    row_begin,
+		    row_end,
+		    act
+		);
+	}
+
+	linear_context_t *ctx = tnn_safe_malloc(sizeof(linear_context_t));
+	ctx->act = act;
+
+	output->parents[0] = input;
+	output->parents[1] = weight;
+	output->parents[2] = bias;
+	output->num_parents = 3;
+	output->requires_grad = true;
+	input->num_children++;
+	_tnn_retain_state(weight);
+	_tnn_retain_state(bias);
+	output->backward = linear_backward;
+	output->context = ctx;
+	output->free_context = free;
+	if (act == TNN_ACT_NONE) {
+		_tnn_compact_output(output); // relu masks by the output
+	}
+
+	return output;
+}
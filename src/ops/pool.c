@@ -0,0 +1,285 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../impl/compact.h"
+#include "../impl/conv.h"
+#include "../impl/malloc.h"
+
+// fixed number of pixel chunks for parallel loops
+#define POOL_NUM_CHUNKS 64
+
+typedef struct {
+	tnn_conv_shape_t shape; // c_out == c_in
+	uint8_t *argmax; // max: [pixels, c] tap (ki * k + kj) of each max, or NULL
+} pool_context_t;
+
+static void pool_free_context(void *ctx) {
+	pool_context_t *pool_ctx = (pool_context_t *)ctx;
+	free(pool_ctx->argmax);
+	free(pool_ctx);
+}
+
+// input rows [*begin, *end) of a window starting at i_out * s - p
+static void _window_range(
+    size_t i_out, size_t s, size_t p, size_t k, size_t n, int *begin, int *end
+) {
+	*begin = (int)(i_out * s) - (int)p;
+	*end = *begin + (int)k;
+	*begin = *begin > 0 ? *begin : 0;
+	*end = *end < (int)n ? *end : (int)n;
+}
+
+// output pixels [pixel_begin, pixel_end), argmax is NULL for avg
+static void _pool_forward(
+    const tnn_conv_shape_t *shape,
+    const float *input,
+    float *output,
+    uint8_t *argmax,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c = shape->c_in;
+	size_t k = shape->kernel_size;
+	size_t hw_out = shape->h_out * shape->w_out;
+
+	for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+		size_t b = pixel / hw_out;
+		size_t i_out = pixel % hw_out / shape->w_out;
+		size_t j_out = pixel % shape->w_out;
+		float *restrict out_pixel = output + pixel * c;
+
+		int i_begin, i_end, j_begin, j_end;
+		_window_range(
+		    i_out, shape->stride, shape->padding, k, h_in, &i_begin, &i_end
+		);
+		_window_range(
+		    j_out, shape->stride, shape->padding, k, w_in, &j_begin, &j_end
+		);
+
+		// padding is never selected (max) nor counted (avg)
+		if (argmax == NULL) {
+			for (size_t ch = 0; ch < c; ch++) {
+				out_pixel[ch] = 0.0f;
+			}
+			for (int i_in = i_begin; i_in < i_end; i_in++) {
+				for (int j_in = j_begin; j_in < j_end; j_in++) {
+					const float *restrict in_pixel =
+					    input + ((b * h_in + i_in) * w_in + j_in) * c;
+					for (size_t ch = 0; ch < c; ch++) {
+						out_pixel[ch] += in_pixel[ch];
+					}
+				}
+			}
+			float count = (float)((i_end - i_begin) * (j_end - j_begin));
+			for (size_t ch = 0; ch < c; ch++) {
+				out_pixel[ch] /= count;
+			}
+			continue;
+		}
+
+		// window position of (i_in, j_in) is (i_in - i_origin, j_in - j_origin)
+		int i_origin = (int)(i_out * shape->stride) - (int)shape->padding;
+		int j_origin = (int)(j_out * shape->stride) - (int)shape->padding;
+		uint8_t *restrict arg_pixel = argmax + pixel * c;
+
+		// seeded with the first in-bounds element, so windows of -inf or NaN
+		// still get a valid tap
+		const float *restrict first =
+		    input + ((b * h_in + i_begin) * w_in + j_begin) * c;
+		uint8_t first_tap =
+		    (uint8_t)((i_begin - i_origin) * (int)k + (j_begin - j_origin));
+		for (size_t ch = 0; ch < c; ch++) {
+			out_pixel[ch] = first[ch];
+			arg_pixel[ch] = first_tap;
+		}
+
+		for (int i_in = i_begin; i_in < i_end; i_in++) {
+			for (int j_in = j_begin; j_in < j_end; j_in++) {
+				const float *restrict in_pixel =
+				    input + ((b * h_in + i_in) * w_in + j_in) * c;
+				int ki = i_in - i_origin;
+				int kj = j_in - j_origin;
+				uint8_t tap = (uint8_t)(ki * (int)k + kj);
+				// strict: the first max in the window wins
+				for (size_t ch = 0; ch < c; ch++) {
+					bool greater = in_pixel[ch] > out_pixel[ch];
+					out_pixel[ch] = greater ? in_pixel[ch] : out_pixel[ch];
+					arg_pixel[ch] = greater ? tap : arg_pixel[ch];
+				}
+			}
+		}
+	}
+}
+
+// gathered per input pixel (windows may overlap), argmax is NULL for avg
+static void _pool_input_grad(
+    const tnn_conv_shape_t *shape,
+    const float *output_grad,
+    const uint8_t *argmax,
+    float *input_grad,
+    size_t pixel_begin,
+    size_t pixel_end
+) {
+	size_t h_in = shape->h_in;
+	size_t w_in = shape->w_in;
+	size_t c = shape->c_in;
+	size_t k = shape->kernel_size;
+	size_t s = shape->stride;
+	size_t p = shape->padding;
+	size_t hw_in = h_in * w_in;
+
+	for (size_t pixel = pixel_begin; pixel < pixel_end; pixel++) {
+		size_t b = pixel / hw_in;
+		size_t i_in = pixel % hw_in / w_in;
+		size_t j_in = pixel % w_in;
+		float *restrict in_grad_pixel = input_grad + pixel * c;
+
+		// clang-format off
+		for (size_t ki = 0; ki < k; ki++) {
+		for (size_t kj = 0; kj < k; kj++) {
+			// output pixel reading this input pixel at tap (ki, kj)
+			int i_strided = (int)(i_in + p) - (int)ki;
+			int j_strided = (int)(j_in + p) - (int)kj;
+			if (i_strided < 0 || i_strided % s != 0 ||
+			    j_strided < 0 || j_strided % s != 0) {
+				continue;
+			}
+			size_t i_out = i_strided / s;
+			size_t j_out = j_strided / s;
+			if (i_out >= shape->h_out || j_out >= shape->w_out) {
+				continue;
+			}
+
+			size_t out_pixel =
+			    (b * shape->h_out + i_out) * shape->w_out + j_out;
+			const float *restrict out_grad_pixel = output_grad + out_pixel * c;
+
+			if (argmax == NULL) {
+				int i_begin, i_end, j_begin, j_end;
+				_window_range(i_out, s, p, k, h_in, &i_begin, &i_end);
+				_window_range(j_out, s, p, k, w_in, &j_begin, &j_end);
+				float count = (float)((i_end - i_begin) * (j_end - j_begin));
+				for (size_t ch = 0; ch < c; ch++) {
+					in_grad_pixel[ch] += out_grad_pixel[ch] / count;
+				}
+				continue;
+			}
+
+			const uint8_t *restrict arg_pixel = argmax + out_pixel * c;
+			uint8_t tap = (uint8_t)(ki * k + kj);
+			for (size_t ch = 0; ch < c; ch++) {
+				in_grad_pixel[ch] +=
+				    arg_pixel[ch] == tap ? out_grad_pixel[ch] : 0.0f;
+			}
+		}
+		}
+		// clang-format on
+	}
+}
+
+static void pool_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+
+	if (!input->requires_grad) {
+		return;
+	}
+
+	assert(self->context != NULL);
+	pool_context_t *ctx = (pool_context_t *)self->context;
+	const tnn_conv_shape_t *shape = &ctx->shape;
+
+	size_t num_pixels = shape->batch * shape->h_in * shape->w_in;
+	size_t num_chunks =
+	    num_pixels < POOL_NUM_CHUNKS ? num_pixels : POOL_NUM_CHUNKS;
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		_pool_input_grad(
+		    shape,
+		    self->grad,
+		    ctx->argmax,
+		    input->grad,
+		    num_pixels * chunk / num_chunks,
+		    num_pixels * (chunk + 1) / num_chunks
+		);
+	}
+}
+
+static tnn_tensor_t *_pool(
+    tnn_tensor_t *input,
+    size_t kernel_size,
+    size_t stride,
+    size_t padding,
+    bool max
+) {
+	assert(input->num_dims >= 3);
+	assert(kernel_size > 0 && stride > 0);
+	// every window must overlap the input
+	assert(padding < kernel_size && "padding must be less than kernel_size");
+	// taps must fit the argmax bytes
+	assert(kernel_size * kernel_size <= 256 && "kernel_size is too large");
+	tnn_realize(input);
+
+	size_t channels = input->dims[input->num_dims - 1];
+	pool_context_t *ctx = tnn_safe_malloc(sizeof(pool_context_t));
+	ctx->shape =
+	    _tnn_conv_shape(input, channels, kernel_size, stride, padding);
+	const tnn_conv_shape_t *shape = &ctx->shape;
+
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	_tnn_conv_output_dims(shape, input, output_dims);
+	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
+	output->channels = input->channels; // windows of padded lanes are all 0
+
+	// one byte per output element is kept for backward instead of the input
+	ctx->argmax = max ? tnn_safe_malloc(tnn_size(output)) : NULL;
+
+	size_t num_pixels = shape->batch * shape->h_out * shape->w_out;
+	size_t num_chunks =
+	    num_pixels < POOL_NUM_CHUNKS ? num_pixels : POOL_NUM_CHUNKS;
+#pragma omp parallel for schedule(static)
+	for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+		_pool_forward(
+		    shape,
+		    input->data,
+		    output->data,
+		    ctx->argmax,
+		    num_pixels * chunk / num_chunks,
+		    num_pixels * (chunk + 1) / num_chunks
+		);
+	}
+
+	output->parents[0] = input;
+	output->num_parents = 1;
+	input->num_children++;
+	output->requires_grad = input->requires_grad;
+	output->backward = pool_backward;
+	output->context = ctx;
+	output->free_context = pool_free_context;
+	_tnn_compact_output(output);
+	_tnn_compact_parent(output, 0);
+
+	return output;
+}
+
+tnn_tensor_t *_tnn_maxpool(
+    tnn_tensor_t *input, size_t kernel_size, size_t stride, size_t padding
+) {
+	return _pool(input, kernel_size, stride, padding, true);
+}
+
+tnn_tensor_t *_tnn_avgpool(
+    tnn_tensor_t *input, size_t kernel_size, size_t stride, size_t padding
+) {
+	return _pool(input, kernel_size, stride, padding, false);
+}
@@ -5,37 +5,17 @@
 #include <memory.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
-static void matmul(
-    const float *a,
-    const float *b,
-    float *c,
-    size_t m,
-    size_t k,
-    size_t n,
-    bool tpose_a,
-    bool tpose_b,
-    bool accum
-) {
-	// C[M, N] = A[M, K] @ B[K, N]
-	for (size_t i_m = 0; i_m < m; i_m++) {
-		for (size_t i_n = 0; i_n < n; i_n++) {
-			float sum = 0.0f;
-			for (size_t i_k = 0; i_k < k; i_k++) {
-				float a_val = tpose_a ? a[i_k * m + i_m] : a[i_m * k + i_k];
-				float b_val = tpose_b ? b[i_n * k + i_k] : b[i_k * n + i_n];
-				sum += a_val * b_val;
-			}
-
-			if (accum) {
-				c[i_m * n + i_n] += sum;
-			} else {
-				c[i_m * n + i_n] = sum;
-			}
-		}
-	}
-}
+#include "../impl/backend.h"
+#include "../impl/compact.h"
+#include "../impl/int8.h"
+#include "../impl/linear.h"
+#include "../impl/malloc.h"
+#include "../impl/quant.h"
+#include "../impl/rng.h"
+#include "../impl/state.h"
 
 static void proj_backward(tnn_tensor_t *self) {
 	tnn_tensor_t *input = self->parents[0];
@@ -50,7 +30,7 @@ static void proj_backward(tnn_tensor_t *self) {
 
 	if (input->requires_grad) {
 		// input->grad = self->grad @ weight^T
-		matmul(
+		_tnn_backend->sgemm(
 		    self->grad,
 		    weight->data,
 		    input->grad,
@@ -65,7 +45,7 @@ static void proj_backward(tnn_tensor_t *self) {
 
 	if (weight->requires_grad) {
 		// weight->grad += input^T @ self->grad
-		matmul(
+		_tnn_backend->sgemm(
 		    input->data,
 		    self->grad,
 		    weight->grad,
@@ -79,34 +59,114 @@ static void proj_backward(tnn_tensor_t *self) {
 	}
 }
 
-tnn_tensor_t *tnn_proj(tnn_tensor_t *input, size_t dim_out) {
-	assert(input->num_dims >= 2);
-
+// int8 inference path, see: tnn_quantize()
+static tnn_tensor_t *proj_q8_forward(
+    tnn_tensor_t *input, size_t dim_out, tnn_tensor_t *weight_q8
+) {
 	size_t dim_batch = 1;
 	for (size_t i = 0; i < input->num_dims - 1; i++) {
 		dim_batch *= input->dims[i];
 	}
 	size_t dim_in = input->dims[input->num_dims - 1];
 
-	// get weights
+	// weight_q8 is [dim_out, dim_in] (transposed), rows padded to whole words
+	size_t row_words = _tnn_q8_row_words(dim_in);
+	assert(weight_q8->dims[0] == dim_out && weight_q8->dims[1] == row_words);
+	tnn_tensor_t *scale = tnn_get_state("proj/scale");
+	assert(scale != NULL);
+
+	// static input range from calibration, otherwise dynamic
+	tnn_tensor_t *act = tnn_get_state("proj/act");
+	float input_abs_max = act != NULL
+	                          ? act->data[0]
+	                          : _tnn_abs_max(input->data, dim_batch * dim_in);
+	float input_scale = _tnn_q8_scale(input_abs_max);
+
+	size_t row_bytes = row_words * 4;
+	int8_t *input_q8 = tnn_safe_malloc(dim_batch * row_bytes);
+	for (size_t i_batch = 0; i_batch < dim_batch; i_batch++) {
+		_tnn_quantize_q8(
+		    input_q8 + i_batch * row_bytes,
+		    input->data + i_batch * dim_in,
+		    dim_in,
+		    input_scale
+		);
+	}
+
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	memcpy(output_dims, input->dims, (input->num_dims - 1) * sizeof(size_t));
+	output_dims[input->num_dims - 1] = dim_out;
+	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
+
+	// output = dequant(input_q8 @ weight_q8^T)
+	const int8_t *weight_rows = (const int8_t *)weight_q8->data;
+	for (size_t i_batch = 0; i_batch < dim_batch; i_batch++) {
+		const int8_t *input_row = input_q8 + i_batch * row_bytes;
+		for (size_t i_out = 0; i_out < dim_out; i_out++) {
+			int32_t acc = _tnn_backend->dot_q8(
+			    input_row, weight_rows + i_out * row_bytes, dim_in
+			);
+			output->data[i_batch * dim_out + i_out] =
+			    (float)acc * input_scale * scale->data[i_out];
+		}
+	}
+	free(input_q8);
+
+	// forward-only
+	output->parents[0] = input;
+	output->num_parents = 1;
+	output->requires_grad = false;
+	input->num_children++;
+
+	return output;
+}
+
+tnn_tensor_t *_tnn_proj_weight(size_t dim_in, size_t dim_out) {
 	size_t weight_dims[2] = {dim_in, dim_out};
 	bool weight_created = false;
 	tnn_tensor_t *weight =
 	    tnn_alloc_or_get_state(weight_dims, 2, "proj", &weight_created);
-	weight->requires_grad = true;
+	_tnn_require_grad(weight);
 	if (weight_created) {
 		// uniform xavier init
-		size_t fan_in = weight->dims[weight->num_dims - 2];
-		size_t fan_out = weight->dims[weight->num_dims - 1];
+		float limit = sqrtf(6.0f / (dim_in + dim_out));
 
-		float limit = sqrtf(6.0f / (fan_in + fan_out));
+		_tnn_fill_uniform(
+		    weight->data,
+		    tnn_size(weight),
+		    _tnn_state_stream("proj"),
+		    -limit,
+		    limit
+		);
+	}
+	return weight;
+}
 
-		size_t total_size = tnn_size(weight);
-		for (size_t i = 0; i < total_size; i++) {
-			float u = (float)rand() / (float)RAND_MAX;
-			weight->data[i] = u * 2.0f * limit - limit;
-		}
+tnn_tensor_t *tnn_proj(tnn_tensor_t *input, size_t dim_out) {
+	assert(input->num_dims >= 2);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
+
+	tnn_tensor_t *weight_q8 = tnn_get_state("proj/q8");
+	if (weight_q8 != NULL) {
+		return proj_q8_forward(input, dim_out, weight_q8);
+	}
+	if (tnn_state.calibrating) {
+		_tnn_calibrate_observe("proj", input);
+	}
+
+	size_t dim_batch = 1;
+	for (size_t i = 0; i < input->num_dims - 1; i++) {
+		dim_batch *= input->dims[i];
 	}
+	size_t dim_in = input->dims[input->num_dims - 1];
+
+	// get weights
+	tnn_tensor_t *weight = _tnn_proj_weight(dim_in, dim_out);
 
 	size_t output_dims[100];
 	if (input->num_dims > 100) {
@@ -118,7 +178,7 @@ tnn_tensor_t *tnn_proj(tnn_tensor_t *input, size_t dim_out) {
 	tnn_tensor_t *output = tnn_alloc(output_dims, input->num_dims);
 
 	// output = input @ weight
-	matmul(
+	_tnn_backend->sgemm(
 	    input->data,
 	    weight->data,
 	    output->data,
@@ -135,8 +195,9 @@ tnn_tensor_t *tnn_proj(tnn_tensor_t *input, size_t dim_out) {
 	output->num_parents = 2;
 	output->requires_grad = true;
 	input->num_children++;
-	weight->num_children++;
+	_tnn_retain_state(weight);
 	output->backward = proj_backward;
+	_tnn_compact_output(output);
 
 	return output;
 }
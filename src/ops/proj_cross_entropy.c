@@ -0,0 +1,351 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <math.h>
+#include <memory.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../impl/exp.h"
+#include "../impl/linear.h"
+#include "../impl/malloc.h"
+#include "../impl/quant.h"
+#include "../impl/state.h"
+
+// batch rows sharing each weight chunk load
+#define PCE_TILE_ROWS 16
+// classes per logits chunk, a [PCE_TILE_ROWS, PCE_CHUNK_CLASSES] buffer is
+// the only logits storage
+#define PCE_CHUNK_CLASSES 512
+
+typedef struct {
+	float *lse; // [batch_size], log-sum-exp of each row
+} proj_cross_entropy_context_t;
+
+static void proj_cross_entropy_free_context(void *ctx) {
+	proj_cross_entropy_context_t *pce_ctx =
+	    (proj_cross_entropy_context_t *)ctx;
+	free(pce_ctx->lse);
+	free(pce_ctx);
+}
+
+// logits[r - row_begin, c - class_begin] = input[r, :] @ weight[:, c]
+// for r in [row_begin, row_end), c in [class_begin, class_end)
+static void _chunk_logits(
+    const float *input,
+    const float *weight,
+    float *logits,
+    size_t dim_in,
+    size_t num_classes,
+    size_t row_begin,
+    size_t row_end,
+    size_t class_begin,
+    size_t class_end
+) {
+	size_t n = class_end - class_begin;
+	memset(logits, 0, (row_end - row_begin) * n * sizeof(float));
+
+	for (size_t i_in = 0; i_in < dim_in; i_in++) {
+		const float *restrict weight_row =
+		    weight + i_in * num_classes + class_begin;
+		for (size_t r = row_begin; r < row_end; r++) {
+			float a = input[r * dim_in + i_in];
+			if (a == 0.0f) {
+				continue;
+			}
+			float *restrict logits_row = logits + (r - row_begin) * n;
+			for (size_t c = 0; c < n; c++) {
+				logits_row[c] += a * weight_row[c];
+			}
+		}
+	}
+}
+
+// logits chunk -> d(loss)/d(logits) = scale * (softmax - onehot), in place
+static void _chunk_logits_grad(
+    float *logits,
+    const float *lse,
+    const float *target,
+    float scale,
+    size_t row_begin,
+    size_t row_end,
+    size_t class_begin,
+    size_t class_end
+) {
+	size_t n = class_end - class_begin;
+	for (size_t r = row_begin; r < row_end; r++) {
+		float *logits_row = logits + (r - row_begin) * n;
+		float row_lse = lse[r];
+		for (size_t c = 0; c < n; c++) {
+			logits_row[c] = scale * _tnn_expf(logits_row[c] - row_lse);
+		}
+		size_t label = (size_t)target[r];
+		if (label >= class_begin && label < class_end) {
+			logits_row[label - class_begin] -= scale;
+		}
+	}
+}
+
+static void proj_cross_entropy_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+	tnn_tensor_t *weight = self->parents[1];
+	tnn_tensor_t *target = self->parents[2];
+
+	assert(self->context != NULL);
+	proj_cross_entropy_context_t *ctx =
+	    (proj_cross_entropy_context_t *)self->context;
+
+	size_t batch_size = input->dims[0];
+	size_t dim_in = weight->dims[0];
+	size_t num_classes = weight->dims[1];
+	float scale = self->grad[0] / (float)batch_size;
+
+	size_t num_tiles = (batch_size + PCE_TILE_ROWS - 1) / PCE_TILE_ROWS;
+	size_t num_chunks =
+	    (num_classes + PCE_CHUNK_CLASSES - 1) / PCE_CHUNK_CLASSES;
+
+	// logits are recomputed chunk by chunk, once per gradient so each sweep
+	// owns the rows it writes (no atomics, same result for any thread count)
+
+	// weight->grad[:, chunk] += input^T @ logits_grad[:, chunk]
+	if (weight->requires_grad) {
+#pragma omp parallel for schedule(static)
+		for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+			size_t class_begin = chunk * PCE_CHUNK_CLASSES;
+			size_t class_end = class_begin + PCE_CHUNK_CLASSES;
+			if (class_end > num_classes) {
+				class_end = num_classes;
+			}
+			size_t n = class_end - class_begin;
+			float *logits =
+			    tnn_safe_malloc(PCE_TILE_ROWS * n * sizeof(float));
+
+			for (size_t tile = 0; tile < num_tiles; tile++) {
+				size_t row_begin = tile * PCE_TILE_ROWS;
+				size_t row_end = row_begin + PCE_TILE_ROWS;
+				if (row_end > batch_size) {
+					row_end = batch_size;
+				}
+				_chunk_logits(
+				    input->data,
+				    weight->data,
+				    logits,
+				    dim_in,
+				    num_classes,
+				    row_begin,
+				    row_end,
+				    class_begin,
+				    class_end
+				);
+				_chunk_logits_grad(
+				    logits,
+				    ctx->lse,
+				    target->data,
+				    scale,
+				    row_begin,
+				    row_end,
+				    class_begin,
+				    class_end
+				);
+
+				for (size_t i_in = 0; i_in < dim_in; i_in++) {
+					float *restrict grad_row =
+					    weight->grad + i_in * num_classes + class_begin;
+					for (size_t r = row_begin; r < row_end; r++) {
+						float a = input->data[r * dim_in + i_in];
+						if (a == 0.0f) {
+							continue;
+						}
+						const float *restrict logits_row =
+						    logits + (r - row_begin) * n;
+						for (size_t c = 0; c < n; c++) {
+							grad_row[c] += a * logits_row[c];
+						}
+					}
+				}
+			}
+
+			free(logits);
+		}
+	}
+
+	// input->grad[tile, :] += logits_grad[tile, :] @ weight^T
+	if (input->requires_grad) {
+#pragma omp parallel for schedule(static)
+		for (size_t tile = 0; tile < num_tiles; tile++) {
+			size_t row_begin = tile * PCE_TILE_ROWS;
+			size_t row_end = row_begin + PCE_TILE_ROWS;
+			if (row_end > batch_size) {
+				row_end = batch_size;
+			}
+			float *logits = tnn_safe_malloc(
+			    PCE_TILE_ROWS * PCE_CHUNK_CLASSES * sizeof(float)
+			);
+
+			for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+				size_t class_begin = chunk * PCE_CHUNK_CLASSES;
+				size_t class_end = class_begin + PCE_CHUNK_CLASSES;
+				if (class_end > num_classes) {
+					class_end = num_classes;
+				}
+				size_t n = class_end - class_begin;
+				_chunk_logits(
+				    input->data,
+				    weight->data,
+				    logits,
+				    dim_in,
+				    num_classes,
+				    row_begin,
+				    row_end,
+				    class_begin,
+				    class_end
+				);
+				_chunk_logits_grad(
+				    logits,
+				    ctx->lse,
+				    target->data,
+				    scale,
+				    row_begin,
+				    row_end,
+				    class_begin,
+				    class_end
+				);
+
+				for (size_t r = row_begin; r < row_end; r++) {
+					const float *logits_row = logits + (r - row_begin) * n;
+					float *grad_row = input->grad + r * dim_in;
+					for (size_t i_in = 0; i_in < dim_in; i_in++) {
+						const float *weight_row =
+						    weight->data + i_in * num_classes + class_begin;
+						float sum = 0.0f;
+						for (size_t c = 0; c < n; c++) {
+							sum += logits_row[c] * weight_row[c];
+						}
+						grad_row[i_in] += sum;
+					}
+				}
+			}
+
+			free(logits);
+		}
+	}
+}
+
+tnn_tensor_t *tnn_proj_cross_entropy(
+    tnn_tensor_t *input, size_t num_classes, tnn_tensor_t *target
+) {
+	assert(input->num_dims == 2 && "input must be 2D [batch, dim_in]");
+	assert(target->num_dims == 1 && "target must be 1D [batch]");
+	assert(target->dims[0] == input->dims[0]);
+	assert(num_classes > 0);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
+	tnn_realize(target);
+
+	// quantized layers are inference-only, plain ops handle them
+	if (tnn_get_state("proj/q8") != NULL) {
+		return tnn_sparse_cross_entropy(tnn_proj(input, num_classes), target);
+	}
+	if (tnn_state.calibrating) {
+		_tnn_calibrate_observe("proj", input);
+	}
+
+	size_t batch_size = input->dims[0];
+	size_t dim_in = input->dims[1];
+
+	// same state as the unfused tnn_proj()
+	tnn_tensor_t *weight = _tnn_proj_weight(dim_in, num_classes);
+
+	// allocate scalar output
+	tnn_tensor_t *output = tnn_alloc(NULL, 0);
+
+	float *lse = tnn_safe_malloc(batch_size * sizeof(float));
+	float *row_loss = tnn_safe_malloc(batch_size * sizeof(float));
+
+	// stream over class chunks with an online log-sum-exp per row
+	size_t num_tiles = (batch_size + PCE_TILE_ROWS - 1) / PCE_TILE_ROWS;
+#pragma omp parallel for schedule(static)
+	for (size_t tile = 0; tile < num_tiles; tile++) {
+		size_t row_begin = tile * PCE_TILE_ROWS;
+		size_t row_end = row_begin + PCE_TILE_ROWS;
+		if (row_end > batch_size) {
+			row_end = batch_size;
+		}
+		float *logits =
+		    tnn_safe_malloc(PCE_TILE_ROWS * PCE_CHUNK_CLASSES * sizeof(float));
+		float max[PCE_TILE_ROWS], sum[PCE_TILE_ROWS];
+		float target_logit[PCE_TILE_ROWS];
+		for (size_t r = 0; r < PCE_TILE_ROWS; r++) {
+			max[r] = -INFINITY;
+			sum[r] = 0.0f;
+		}
+
+		for (size_t class_begin = 0; class_begin < num_classes;
+		     class_begin += PCE_CHUNK_CLASSES) {
+			size_t class_end = class_begin + PCE_CHUNK_CLASSES;
+			if (class_end > num_classes) {
+				class_end = num_classes;
+			}
+			size_t n = class_end - class_begin;
+			_chunk_logits(
+			    input->data,
+			    weight->data,
+			    logits,
+			    dim_in,
+			    num_classes,
+			    row_begin,
+			    row_end,
+			    class_begin,
+			    class_end
+			);
+
+			for (size_t r = row_begin; r < row_end; r++) {
+				const float *logits_row = logits + (r - row_begin) * n;
+				size_t t = r - row_begin;
+				_tnn_lse_update(&max[t], &sum[t], logits_row, n);
+
+				size_t label = (size_t)target->data[r];
+				if (label >= class_begin && label < class_end) {
+					target_logit[t] = logits_row[label - class_begin];
+				}
+			}
+		}
+
+		for (size_t r = row_begin; r < row_end; r++) {
+			size_t t = r - row_begin;
+			assert(target->data[r] >= 0.0f);
+			assert(target->data[r] < (float)num_classes);
+			lse[r] = max[t] + logf(sum[t]);
+			row_loss[r] = lse[r] - target_logit[t];
+		}
+
+		free(logits);
+	}
+
+	// summed in order, independent of thread count
+	float total_loss = 0.0f;
+	for (size_t i = 0; i < batch_size; i++) {
+		total_loss += row_loss[i];
+	}
+	free(row_loss);
+
+	output->data[0] = total_loss / (float)batch_size;
+
+	proj_cross_entropy_context_t *ctx =
+	    tnn_safe_malloc(sizeof(proj_cross_entropy_context_t));
+	ctx->lse = lse;
+
+	output->parents[0] = input;
+	output->parents[1] = weight;
+	output->parents[2] = target;
+	output->num_parents = 3;
+	output->requires_grad = true;
+	input->num_children++;
+	_tnn_retain_state(weight);
+	target->num_children++;
+	output->backward = proj_cross_entropy_backward;
+	output->context = ctx;
+	output->free_context = proj_cross_entropy_free_context;
+
+	return output;
+}
@@ -0,0 +1,276 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../impl/compact.h"
+#include "../impl/malloc.h"
+
+// work items (outer rows x reduced blocks) a reduction is split into, fixed so
+// results don't depend on the thread count
+#define REDUCE_NUM_CHUNKS 64
+// minimum elements per reduced block, smaller reductions aren't split
+#define REDUCE_MIN_BLOCK 4096
+// independent accumulators for contiguous reductions (inner_size == 1)
+#define REDUCE_LANES 8
+
+// input viewed as [outer_size, reduced_size, inner_size]
+typedef struct {
+	tnn_reduce_op_t op;
+	size_t outer_size, reduced_size, inner_size;
+} reduce_context_t;
+
+static inline float _identity(tnn_reduce_op_t op) {
+	switch (op) {
+	case TNN_REDUCE_MAX:
+		return -INFINITY;
+	case TNN_REDUCE_MIN:
+		return INFINITY;
+	default:
+		return 0.0f;
+	}
+}
+
+static inline float _combine(tnn_reduce_op_t op, float a, float b) {
+	switch (op) {
+	case TNN_REDUCE_MAX:
+		return b > a ? b : a;
+	case TNN_REDUCE_MIN:
+		return b < a ? b : a;
+	default:
+		return a + b;
+	}
+}
+
+// out[inner_size] = reduction of x[reduced_begin:reduced_end, :]
+static void _reduce_block(
+    tnn_reduce_op_t op,
+    const float *x,
+    float *restrict out,
+    size_t reduced_begin,
+    size_t reduced_end,
+    size_t inner_size
+) {
+	float id = _identity(op);
+
+	if (inner_size == 1) {
+		// contiguous: strided lanes, combined at the end
+		float lanes[REDUCE_LANES];
+		for (size_t l = 0; l < REDUCE_LANES; l++) {
+			lanes[l] = id;
+		}
+		size_t r = reduced_begin;
+		for (; r + REDUCE_LANES <= reduced_end; r += REDUCE_LANES) {
+			for (size_t l = 0; l < REDUCE_LANES; l++) {
+				lanes[l] = _combine(op, lanes[l], x[r + l]);
+			}
+		}
+		for (; r < reduced_end; r++) {
+			lanes[0] = _combine(op, lanes[0], x[r]);
+		}
+		for (size_t w = REDUCE_LANES / 2; w > 0; w /= 2) {
+			for (size_t l = 0; l < w; l++) {
+				lanes[l] = _combine(op, lanes[l], lanes[l + w]);
+			}
+		}
+		out[0] = lanes[0];
+		return;
+	}
+
+	// strided: whole inner rows, contiguous in the innermost loop
+	for (size_t i = 0; i < inner_size; i++) {
+		out[i] = id;
+	}
+	for (size_t r = reduced_begin; r < reduced_end; r++) {
+		const float *restrict x_row = x + r * inner_size;
+		for (size_t i = 0; i < inner_size; i++) {
+			out[i] = _combine(op, out[i], x_row[i]);
+		}
+	}
+}
+
+static void reduce_backward(tnn_tensor_t *self) {
+	tnn_tensor_t *input = self->parents[0];
+
+	if (!input->requires_grad) {
+		return;
+	}
+
+	assert(self->context != NULL);
+	reduce_context_t *ctx = (reduce_context_t *)self->context;
+	size_t reduced_size = ctx->reduced_size;
+	size_t inner_size = ctx->inner_size;
+
+	if (ctx->op == TNN_REDUCE_SUM || ctx->op == TNN_REDUCE_MEAN) {
+		// each input element contributed 1 (or 1/n) to its output
+		float grad_coeff =
+		    ctx->op == TNN_REDUCE_MEAN ? 1.0f / (float)reduced_size : 1.0f;
+		size_t num_rows = ctx->outer_size * reduced_size;
+
+		// broadcast gradient from output to input
+#pragma omp parallel for schedule(static)
+		for (size_t row = 0; row < num_rows; row++) {
+			const float *grad_row =
+			    self->grad + (row / reduced_size) * inner_size;
+			float *input_grad_row = input->grad + row * inner_size;
+			for (size_t i = 0; i < inner_size; i++) {
+				input_grad_row[i] += grad_row[i] * grad_coeff;
+			}
+		}
+		return;
+	}
+
+	// max/min: the first input element equal to the output takes the grad
+#pragma omp parallel for schedule(static)
+	for (size_t outer = 0; outer < ctx->outer_size; outer++) {
+		const float *x = input->data + outer * reduced_size * inner_size;
+		float *x_grad = input->grad + outer * reduced_size * inner_size;
+		const float *y = self->data + outer * inner_size;
+		const float *y_grad = self->grad + outer * inner_size;
+
+		bool *found = calloc(inner_size, sizeof(bool));
+		assert(found != NULL && "calloc failed");
+		size_t num_found = 0;
+		for (size_t r = 0; r < reduced_size && num_found < inner_size; r++) {
+			for (size_t i = 0; i < inner_size; i++) {
+				if (!found[i] && x[r * inner_size + i] == y[i]) {
+					x_grad[r * inner_size + i] += y_grad[i];
+					found[i] = true;
+					num_found++;
+				}
+			}
+		}
+		free(found);
+	}
+}
+
+tnn_tensor_t *_tnn_reduce(
+    tnn_tensor_t *input, tnn_reduce_op_t op, size_t i_dim, size_t num_dims
+) {
+	assert(input != NULL);
+	assert(num_dims > 0);
+	assert(i_dim + num_dims <= input->num_dims);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
+
+	// calculate output dimensions - remove the reduced dimensions
+	size_t output_dims[100];
+	if (input->num_dims > 100) {
+		fprintf(stderr, "input has too many dims (%zu)\n", input->num_dims);
+		exit(1);
+	}
+	size_t output_num_dims = input->num_dims - num_dims;
+	// copy dims before and after the reduced range
+	for (size_t i = 0; i < i_dim; i++) {
+		output_dims[i] = input->dims[i];
+	}
+	for (size_t i = i_dim + num_dims; i < input->num_dims; i++) {
+		output_dims[i - num_dims] = input->dims[i];
+	}
+	// allocate output tensor
+	tnn_tensor_t *output = tnn_alloc(output_dims, output_num_dims);
+
+	// the number of elements to reduce over
+	size_t reduced_size = 1;
+	for (size_t i = i_dim; i < i_dim + num_dims; i++) {
+		reduced_size *= input->dims[i];
+	}
+	assert(reduced_size > 0);
+	// outer size (product of dims before reduced range)
+	size_t outer_size = 1;
+	for (size_t i = 0; i < i_dim; i++) {
+		outer_size *= input->dims[i];
+	}
+	// inner size (product of dims after reduced range)
+	size_t inner_size = 1;
+	for (size_t i = i_dim + num_dims; i < input->num_dims; i++) {
+		inner_size *= input->dims[i];
+	}
+
+	// split the reduced range into blocks when there are too few outer rows
+	// to go around, partial results are combined in a fixed tree
+	size_t num_blocks = 1;
+	if (outer_size < REDUCE_NUM_CHUNKS) {
+		num_blocks = REDUCE_NUM_CHUNKS / outer_size;
+		size_t max_blocks = reduced_size * inner_size / REDUCE_MIN_BLOCK;
+		num_blocks = num_blocks < max_blocks ? num_blocks : max_blocks;
+		num_blocks = num_blocks < reduced_size ? num_blocks : reduced_size;
+		num_blocks = num_blocks > 0 ? num_blocks : 1;
+	}
+
+	// [outer_size, num_blocks, inner_size]
+	float *partial = output->data;
+	if (num_blocks > 1) {
+		partial = tnn_safe_malloc(
+		    outer_size * num_blocks * inner_size * sizeof(float)
+		);
+	}
+
+	size_t num_items = outer_size * num_blocks;
+#pragma omp parallel for schedule(static)
+	for (size_t item = 0; item < num_items; item++) {
+		size_t outer = item / num_blocks;
+		size_t block = item % num_blocks;
+		_reduce_block(
+		    op,
+		    input->data + outer * reduced_size * inner_size,
+		    partial + item * inner_size,
+		    reduced_size * block / num_blocks,
+		    reduced_size * (block + 1) / num_blocks,
+		    inner_size
+		);
+	}
+
+	if (num_blocks > 1) {
+#pragma omp parallel for schedule(static)
+		for (size_t outer = 0; outer < outer_size; outer++) {
+			float *blocks = partial + outer * num_blocks * inner_size;
+			for (size_t stride = 1; stride < num_blocks; stride *= 2) {
+				for (size_t b = 0; b + stride < num_blocks; b += 2 * stride) {
+					float *a_row = blocks + b * inner_size;
+					const float *b_row = blocks + (b + stride) * inner_size;
+					for (size_t i = 0; i < inner_size; i++) {
+						a_row[i] = _combine(op, a_row[i], b_row[i]);
+					}
+				}
+			}
+			memcpy(
+			    output->data + outer * inner_size,
+			    blocks,
+			    inner_size * sizeof(float)
+			);
+		}
+		free(partial);
+	}
+
+	if (op == TNN_REDUCE_MEAN) {
+		size_t total_size = outer_size * inner_size;
+		for (size_t i = 0; i < total_size; i++) {
+			output->data[i] /= (float)reduced_size;
+		}
+	}
+
+	reduce_context_t *ctx = tnn_safe_malloc(sizeof(reduce_context_t));
+	ctx->op = op;
+	ctx->outer_size = outer_size;
+	ctx->reduced_size = reduced_size;
+	ctx->inner_size = inner_size;
+
+	output->parents[0] = input;
+	output->num_parents = 1;
+	input->num_children++;
+	output->requires_grad = input->requires_grad;
+	output->backward = reduce_backward;
+	output->context = ctx;
+	output->free_context = free;
+	if (op == TNN_REDUCE_SUM || op == TNN_REDUCE_MEAN) {
+		_tnn_compact_output(output);
+		_tnn_compact_parent(output, 0);
+	}
+
+	return output;
+}
@@ -3,15 +3,24 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "../impl/compact.h"
+#include "../impl/lazy.h"
+#include "../impl/state.h"
 
 static void relu_backward(tnn_tensor_t *self) {
 	tnn_tensor_t *input = self->parents[0];
+	// input > 0 bits, see: tnn_compact_activations()
+	const uint32_t *mask = (const uint32_t *)self->context;
 
 	if (input->requires_grad) {
 		size_t total_size = tnn_size(input);
 		for (size_t i = 0; i < total_size; i++) {
 			// dself/dinput = 1 if input > 0, else 0
-			if (input->data[i] > 0.0f) {
+			bool positive = mask != NULL ? _tnn_mask_get(mask, i)
+			                             : input->data[i] > 0.0f;
+			if (positive) {
 				input->grad[i] += self->grad[i];
 			}
 		}
@@ -21,8 +30,14 @@ static void relu_backward(tnn_tensor_t *self) {
 tnn_tensor_t *tnn_relu(tnn_tensor_t *input) {
 	assert(input != NULL);
 
+	if (tnn_state.deferring) {
+		return _tnn_defer(TNN_LAZY_RELU, input, NULL);
+	}
+	tnn_realize(input);
+
 	// alloc output with same dims as input
 	tnn_tensor_t *output = tnn_alloc(input->dims, input->num_dims);
+	output->channels = input->channels; // padded lanes stay 0
 
 	// output = max(0, input)
 	size_t total_size = tnn_size(input);
@@ -35,6 +50,14 @@ tnn_tensor_t *tnn_relu(tnn_tensor_t *input) {
 	output->num_parents = 1;
 	input->num_children++;
 	output->backward = relu_backward;
+	if (tnn_state.compacting) {
+		uint32_t *mask = _tnn_mask_alloc(total_size);
+		_tnn_mask_positive(mask, input->data, 0, total_size);
+		output->context = mask;
+		output->free_context = free;
+		_tnn_compact_output(output);
+		_tnn_compact_parent(output, 0);
+	}
 
 	return output;
 }
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "../impl/compact.h"
 #include "../impl/malloc.h"
 
 typedef struct {
@@ -41,6 +42,8 @@ tnn_reshape(tnn_tensor_t *input, const size_t *dims, size_t num_dims) {
 	assert(input != NULL);
 	assert(dims != NULL);
 	assert(num_dims > 0);
+	assert(input->channels == 0 && "blocked input, see: tnn_from_blocked()");
+	tnn_realize(input);
 
 	size_t input_size = tnn_size(input);
 
@@ -88,6 +91,8 @@ tnn_reshape(tnn_tensor_t *input, const size_t *dims, size_t num_dims) {
 	output->backward = reshape_backward;
 	output->context = ctx;
 	output->free_context = reshape_free_context;
+	_tnn_compact_output(output);
+	_tnn_compact_parent(output, 0);
 
 	return output;
 }
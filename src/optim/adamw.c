@@ -89,6 +89,7 @@ void _tnn_adamw(tnn_adamw_cfg_t cfg) {
 				param->data[j] -= cfg.lr * (m_hat / (sqrtf(v_hat) + cfg.eps) +
 				                            cfg.wd * param->data[j]);
 			}
+			param->version++;
 
 			entry = entry->next;
 		}
@@ -0,0 +1,76 @@
+#include <tnn/tnn.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./impl/conv.h"
+#include "./impl/key_str_utils.h"
+#include "./impl/malloc.h"
+#include "./impl/prepack.h"
+#include "./impl/state.h"
+
+// packing is rare, one lock covers weights shared between contexts
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+
+const float *_tnn_packed(
+    tnn_tensor_t *weight, tnn_pack_kind_t kind, size_t size, tnn_pack_fn_t pack
+) {
+	pthread_mutex_lock(&_lock);
+
+	tnn_packed_t *packed = weight->packed;
+	while (packed != NULL && packed->kind != kind) {
+		packed = packed->next;
+	}
+	if (packed == NULL) {
+		packed = tnn_safe_malloc(sizeof(tnn_packed_t));
+		packed->kind = kind;
+		packed->data = tnn_safe_malloc(size * sizeof(float));
+		packed->next = weight->packed;
+		weight->packed = packed;
+		pack(weight, packed->data);
+		packed->version = weight->version;
+	} else if (packed->version != weight->version) {
+		pack(weight, packed->data);
+		packed->version = weight->version;
+	}
+
+	pthread_mutex_unlock(&_lock);
+	return packed->data;
+}
+
+void _tnn_packed_free(tnn_tensor_t *t) {
+	while (t->packed != NULL) {
+		tnn_packed_t *next = t->packed->next;
+		free(t->packed->data);
+		free(t->packed);
+		t->packed = next;
+	}
+}
+
+static bool _is_conv_key(const char *key) {
+	size_t key_len = strlen(key);
+	size_t suffix_len = strlen("conv");
+	return key_len >= suffix_len &&
+	       strcmp(key + key_len - suffix_len, "conv") == 0 &&
+	       (key_len == suffix_len || key[key_len - suffix_len - 1] == '/');
+}
+
+void _tnn_prepack(const char *scope) {
+	char full_scope[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_scope, tnn_state.active_scope, scope);
+	_tnn_materialize_scope(full_scope);
+
+	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
+		tnn_state_entry_t *entry = tnn_state.state_dict[i];
+		while (entry != NULL) {
+			if (_tnn_key_in_scope(entry->key, full_scope) &&
+			    _is_conv_key(entry->key) && entry->param->num_dims == 4) {
+				_tnn_conv_blocked_weight(entry->param);
+			}
+			entry = entry->next;
+		}
+	}
+}
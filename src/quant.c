@@ -0,0 +1,128 @@
+#include <tnn/tnn.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./impl/int8.h"
+#include "./impl/key_str_utils.h"
+#include "./impl/malloc.h"
+#include "./impl/quant.h"
+#include "./impl/state.h"
+
+void tnn_calibrate(bool enabled) {
+	tnn_state.calibrating = enabled;
+}
+
+void _tnn_calibrate_observe(const char *op_key, tnn_tensor_t *input) {
+	char act_key[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(act_key, op_key, "act");
+
+	size_t act_dims[1] = {1};
+	bool act_created = false;
+	tnn_tensor_t *act =
+	    tnn_alloc_or_get_state(act_dims, 1, act_key, &act_created);
+	if (act_created) {
+		act->data[0] = 0.0f;
+	}
+
+	float abs_max = _tnn_abs_max(input->data, tnn_size(input));
+	if (abs_max > act->data[0]) {
+		act->data[0] = abs_max;
+	}
+}
+
+// true if the last component of key is exactly op_key
+static bool _is_op_key(const char *key, const char *op_key) {
+	const char *last_slash = strrchr(key, '/');
+	const char *name = last_slash != NULL ? last_slash + 1 : key;
+	return strcmp(name, op_key) == 0;
+}
+
+static void _quantize_weight(const char *key, bool is_proj) {
+	tnn_tensor_t *weight = _tnn_take_state(key);
+	assert(weight != NULL);
+
+	// quantized rows are output channels:
+	// - proj weight is [dim_in, dim_out], rows are gathered column-wise
+	// - conv weight is [out_channels, kernel_size, kernel_size, in_channels]
+	size_t num_rows, row_len;
+	if (is_proj) {
+		assert(weight->num_dims == 2);
+		num_rows = weight->dims[1];
+		row_len = weight->dims[0];
+	} else {
+		assert(weight->num_dims == 4);
+		num_rows = weight->dims[0];
+		row_len = tnn_size(weight) / num_rows;
+	}
+
+	size_t row_words = _tnn_q8_row_words(row_len);
+	size_t q8_dims[2] = {num_rows, row_words};
+	size_t scale_dims[1] = {num_rows};
+	tnn_tensor_t *weight_q8 = tnn_alloc(q8_dims, 2);
+	tnn_tensor_t *scale = tnn_alloc(scale_dims, 1);
+	weight_q8->is_state = true;
+	scale->is_state = true;
+	memset(weight_q8->data, 0, num_rows * row_words * sizeof(float));
+
+	float *row = tnn_safe_malloc(row_len * sizeof(float));
+	for (size_t r = 0; r < num_rows; r++) {
+		for (size_t i = 0; i < row_len; i++) {
+			row[i] = is_proj ? weight->data[i * num_rows + r]
+			                 : weight->data[r * row_len + i];
+		}
+
+		// per-output-channel scale
+		scale->data[r] = _tnn_q8_scale(_tnn_abs_max(row, row_len));
+		int8_t *row_q8 = (int8_t *)(weight_q8->data + r * row_words);
+		_tnn_quantize_q8(row_q8, row, row_len, scale->data[r]);
+	}
+	free(row);
+
+	char q8_key[TNN_STATE_KEY_MAX_LEN];
+	char scale_key[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(q8_key, key, "q8");
+	_tnn_cat_keys(scale_key, key, "scale");
+	tnn_set_state(q8_key, weight_q8);
+	tnn_set_state(scale_key, scale);
+
+	tnn_free(weight);
+}
+
+void _tnn_quantize(const char *scope) {
+	char full_scope[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_scope, tnn_state.active_scope, scope);
+	_tnn_materialize_scope(full_scope);
+
+	// collect keys first, quantizing edits the dict
+	size_t num_keys = 0;
+	size_t keys_capacity = 64;
+	char **keys = tnn_safe_malloc(keys_capacity * sizeof(char *));
+	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
+		tnn_state_entry_t *entry = tnn_state.state_dict[i];
+		while (entry != NULL) {
+			if (_tnn_key_in_scope(entry->key, full_scope) &&
+			    (_is_op_key(entry->key, "proj") ||
+			     _is_op_key(entry->key, "conv"))) {
+				if (num_keys >= keys_capacity) {
+					keys_capacity *= 2;
+					keys = realloc(keys, keys_capacity * sizeof(char *));
+				}
+				keys[num_keys++] = strdup(
+				    _tnn_relative_key(entry->key, tnn_state.active_scope)
+				);
+			}
+			entry = entry->next;
+		}
+	}
+
+	for (size_t i = 0; i < num_keys; i++) {
+		_quantize_weight(keys[i], _is_op_key(keys[i], "proj"));
+		free(keys[i]);
+	}
+	free(keys);
+}
@@ -0,0 +1,115 @@
+#include <tnn/tnn.h>
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "./impl/key_str_utils.h"
+#include "./impl/rng.h"
+#include "./impl/state.h"
+
+// philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3")
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+// anonymous streams never collide with realistic key hashes
+#define ANON_STREAM_BIT (1ULL << 63)
+
+// 4 random words for block i of stream
+static inline void
+_philox(uint32_t out[4], uint64_t seed, uint64_t stream, uint64_t i) {
+	uint32_t c0 = (uint32_t)i, c1 = (uint32_t)(i >> 32);
+	uint32_t c2 = (uint32_t)stream, c3 = (uint32_t)(stream >> 32);
+	uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+
+	for (int round = 0; round < 10; round++) {
+		uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+		uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+		uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		c1 = (uint32_t)p1;
+		c3 = (uint32_t)p0;
+		c0 = n0;
+		c2 = n2;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+// [0, 1) with 24 bits of precision
+static inline float _to_unit(uint32_t x) {
+	return (float)(x >> 8) * 0x1p-24f;
+}
+
+void tnn_seed(uint64_t seed) {
+	tnn_state.seed = seed;
+	tnn_state.num_anon_streams = 0;
+}
+
+uint64_t _tnn_state_stream(const char *key) {
+	char full_key[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_key, tnn_state.active_scope, key);
+
+	// fnv-1a
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (const char *c = full_key; *c != '\0'; c++) {
+		hash = (hash ^ (uint8_t)*c) * 0x100000001b3ULL;
+	}
+	return hash & ~ANON_STREAM_BIT;
+}
+
+uint64_t _tnn_next_stream(void) {
+	return ANON_STREAM_BIT | tnn_state.num_anon_streams++;
+}
+
+void _tnn_fill_uniform(
+    float *out, size_t n, uint64_t stream, float lo, float hi
+) {
+	// (the context is thread-local, don't touch it in the parallel region)
+	uint64_t seed = tnn_state.seed;
+	float range = hi - lo;
+
+	size_t num_blocks = (n + 3) / 4;
+#pragma omp parallel for schedule(static)
+	for (size_t b = 0; b < num_blocks; b++) {
+		uint32_t words[4];
+		_philox(words, seed, stream, b);
+
+		size_t num_lanes = n - b * 4 < 4 ? n - b * 4 : 4;
+		for (size_t lane = 0; lane < num_lanes; lane++) {
+			out[b * 4 + lane] = lo + _to_unit(words[lane]) * range;
+		}
+	}
+}
+
+void _tnn_fill_normal(float *out, size_t n, uint64_t stream) {
+	uint64_t seed = tnn_state.seed;
+
+	size_t num_blocks = (n + 3) / 4;
+#pragma omp parallel for schedule(static)
+	for (size_t b = 0; b < num_blocks; b++) {
+		uint32_t words[4];
+		_philox(words, seed, stream, b);
+
+		// box-muller, both outputs of each pair are used
+		float z[4];
+		for (int pair = 0; pair < 2; pair++) {
+			float u1 = 1.0f - _to_unit(words[pair * 2]); // (0, 1]
+			float u2 = _to_unit(words[pair * 2 + 1]);
+			float r = sqrtf(-2.0f * logf(u1));
+			float theta = 2.0f * (float)M_PI * u2;
+			z[pair * 2] = r * cosf(theta);
+			z[pair * 2 + 1] = r * sinf(theta);
+		}
+
+		size_t num_lanes = n - b * 4 < 4 ? n - b * 4 : 4;
+		memcpy(out + b * 4, z, num_lanes * sizeof(float));
+	}
+}
@@ -6,24 +6,49 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "./impl/backend.h"
 #include "./impl/key_str_utils.h"
 #include "./impl/malloc.h"
+#include "./impl/mapping.h"
+#include "./impl/offload.h"
 #include "./impl/state.h"
 
-tnn_state_t tnn_state;
+tnn_state_t _tnn_default_ctx;
+_Thread_local tnn_state_t *_tnn_bound_ctx = NULL;
 
-int tnn_init() {
-	tnn_state.active_scope[0] = '\0';
-	memset(tnn_state.state_dict, 0, sizeof(tnn_state.state_dict));
-	return 0;
+// fixed so that runs are reproducible
+#define TNN_DEFAULT_SEED 0x853c49e6748fea9bULL
+
+static void _materialize_scope(tnn_state_t *ctx, const char *scope);
+
+static void _free_pending(tnn_pending_entry_t *pending) {
+	_tnn_mapping_release(pending->mapping);
+	free(pending->key);
+	free(pending->dims);
+	free(pending);
 }
 
-void tnn_terminate() {
-	tnn_state.active_scope[0] = '\0';
+static void _init_ctx(tnn_state_t *ctx, tnn_state_t *shared) {
+	ctx->active_scope[0] = '\0';
+	memset(ctx->state_dict, 0, sizeof(ctx->state_dict));
+	memset(ctx->pending_dict, 0, sizeof(ctx->pending_dict));
+	ctx->shared = shared;
+	ctx->seed = TNN_DEFAULT_SEED;
+	ctx->num_anon_streams = 0;
+	ctx->calibrating = false;
+	ctx->deferring = false;
+	ctx->compacting = false;
+	ctx->compact_bf16 = false;
+	ctx->offload = NULL;
+}
+
+static void _clear_ctx(tnn_state_t *ctx) {
+	ctx->active_scope[0] = '\0';
+	_tnn_offload_disable(ctx);
 
 	// free param table
 	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
-		tnn_state_entry_t *entry = tnn_state.state_dict[i];
+		tnn_state_entry_t *entry = ctx->state_dict[i];
 		while (entry != NULL) {
 			tnn_state_entry_t *next = entry->next;
 			free(entry->key);
@@ -32,8 +57,59 @@ void tnn_terminate() {
 			free(entry);
 			entry = next;
 		}
-		tnn_state.state_dict[i] = NULL;
+		ctx->state_dict[i] = NULL;
+
+		// free pending table
+		tnn_pending_entry_t *pending = ctx->pending_dict[i];
+		while (pending != NULL) {
+			tnn_pending_entry_t *next = pending->next;
+			_free_pending(pending);
+			pending = next;
+		}
+		ctx->pending_dict[i] = NULL;
+	}
+}
+
+int tnn_init() {
+	_tnn_backend_init();
+	_tnn_bound_ctx = NULL;
+	_init_ctx(&_tnn_default_ctx, NULL);
+	return 0;
+}
+
+void tnn_terminate() {
+	_clear_ctx(&_tnn_default_ctx);
+}
+
+tnn_ctx_t *tnn_ctx_create(tnn_ctx_t *shared) {
+	tnn_state_t *ctx = tnn_safe_malloc(sizeof(tnn_state_t));
+	_init_ctx(ctx, shared);
+
+	// readers must never write to shared, so nothing can stay pending there
+	for (tnn_state_t *s = shared; s != NULL; s = s->shared) {
+		_materialize_scope(s, "");
+	}
+
+	return ctx;
+}
+
+void tnn_ctx_destroy(tnn_ctx_t *ctx) {
+	assert(ctx != &_tnn_default_ctx && "use tnn_terminate() instead");
+	if (_tnn_bound_ctx == ctx) {
+		_tnn_bound_ctx = NULL;
 	}
+	_clear_ctx(ctx);
+	free(ctx);
+}
+
+tnn_ctx_t *tnn_ctx_bind(tnn_ctx_t *ctx) {
+	tnn_state_t *prev = _tnn_current_ctx();
+	_tnn_bound_ctx = ctx == &_tnn_default_ctx ? NULL : ctx;
+	return prev;
+}
+
+tnn_ctx_t *tnn_ctx_current() {
+	return _tnn_current_ctx();
 }
 
 void tnn_push(const char *key_fmt, ...) {
@@ -70,130 +146,167 @@ void tnn_pop() {
 	} else {
 		tnn_state.active_scope[0] = '\0';
 	}
+
+	// layer outputs are complete here
+	_tnn_offload_enforce();
 }
 
-void tnn_save(const char *filename) {
-	FILE *fp = fopen(filename, "wb");
-	if (fp == NULL) {
-		fprintf(stderr, "tnn_save() failed to open: %s\n", filename);
-		return;
+static uint32_t _hash_string(const char *str) {
+	uint32_t hash = 5381;
+	int c;
+	while ((c = *str++)) {
+		hash = ((hash << 5) + hash) + c; // hash * 33 + c
 	}
+	return hash;
+}
+
+size_t tnn_list_state_keys(char **out_keys) {
+	_tnn_materialize_scope(tnn_state.active_scope);
 
+	size_t count = 0;
 	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
 		tnn_state_entry_t *entry = tnn_state.state_dict[i];
 		while (entry != NULL) {
-			// skip if not under active scope
-			if (!_tnn_key_in_scope(entry->key, tnn_state.active_scope)) {
-				entry = entry->next;
-				continue;
+			// only list keys in current scope
+			if (_tnn_key_in_scope(entry->key, tnn_state.active_scope)) {
+				if (out_keys != NULL) {
+					const char *relative_key =
+					    _tnn_relative_key(entry->key, tnn_state.active_scope);
+					out_keys[count] = (char *)relative_key;
+				}
+				count++;
 			}
+			entry = entry->next;
+		}
+	}
+	return count;
+}
 
-			tnn_tensor_t *t = entry->param;
-
-			const char *relative_key =
-			    _tnn_relative_key(entry->key, tnn_state.active_scope);
+static void
+_insert_state(tnn_state_t *ctx, const char *full_key, tnn_tensor_t *t) {
+	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
 
-			// write key
-			uint32_t key_len = (uint32_t)strlen(relative_key);
-			fwrite(&key_len, sizeof(uint32_t), 1, fp);
-			fwrite(relative_key, sizeof(char), key_len, fp);
+	tnn_state_entry_t *entry = tnn_safe_malloc(sizeof(tnn_state_entry_t));
+	entry->key = strdup(full_key); // freed upon release
+	entry->param = t;
+	entry->next = ctx->state_dict[hash];
+	// ^ chain with old entry
 
-			// write tensor dims
-			uint32_t num_dims = (uint32_t)t->num_dims;
-			fwrite(&num_dims, sizeof(uint32_t), 1, fp);
-			for (size_t i_dim = 0; i_dim < t->num_dims; i_dim++) {
-				uint32_t dim_u32 = (uint32_t)t->dims[i_dim];
-				fwrite(&dim_u32, sizeof(uint32_t), 1, fp);
-			}
+	ctx->state_dict[hash] = entry;
+}
 
-			// write tensor data
-			size_t total_size = 1;
-			for (uint8_t i_dim = 0; i_dim < t->num_dims; i_dim++) {
-				total_size *= t->dims[i_dim];
-			}
-			fwrite(t->data, sizeof(float), total_size, fp);
+static tnn_tensor_t *_find_state(tnn_state_t *ctx, const char *full_key) {
+	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
+	tnn_state_entry_t *entry = ctx->state_dict[hash];
 
-			entry = entry->next;
+	while (entry != NULL) {
+		if (strcmp(entry->key, full_key) == 0) {
+			return entry->param;
 		}
+		entry = entry->next;
 	}
 
-	fclose(fp);
-}
-
-static uint32_t _hash_string(const char *str) {
-	uint32_t hash = 5381;
-	int c;
-	while ((c = *str++)) {
-		hash = ((hash << 5) + hash) + c; // hash * 33 + c
-	}
-	return hash;
+	return NULL;
 }
 
-void tnn_load(const char *filename) {
-	FILE *fp = fopen(filename, "rb");
-	if (fp == NULL) {
-		fprintf(stderr, "tnn_load() failed to open: %s\n", filename);
-		return;
-	}
-
-	while (true) {
-		// read key
-		uint32_t key_len;
-		if (fread(&key_len, sizeof(uint32_t), 1, fp) != 1) {
-			break; // eof
-		}
-		char *relative_key = tnn_safe_malloc(key_len + 1);
-		fread(relative_key, sizeof(char), key_len, fp);
-		relative_key[key_len] = '\0';
-
-		// read dims
-		uint32_t num_dims;
-		fread(&num_dims, sizeof(uint32_t), 1, fp);
-		size_t *dims = tnn_safe_malloc(num_dims * sizeof(size_t));
-		for (size_t i_dim = 0; i_dim < num_dims; i_dim++) {
-			uint32_t dim_u32;
-			fread(&dim_u32, sizeof(uint32_t), 1, fp);
-			dims[i_dim] = dim_u32;
-		}
+// unlinks the pending entry for full_key, NULL if there is none
+static tnn_pending_entry_t *
+_take_pending(tnn_state_t *ctx, const char *full_key) {
+	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
+	tnn_pending_entry_t *pending = ctx->pending_dict[hash];
+	tnn_pending_entry_t *prev = NULL;
 
-		size_t total_size = 1;
-		for (size_t i_dim = 0; i_dim < num_dims; i_dim++) {
-			total_size *= dims[i_dim];
+	while (pending != NULL) {
+		if (strcmp(pending->key, full_key) == 0) {
+			if (prev == NULL) {
+				ctx->pending_dict[hash] = pending->next;
+			} else {
+				prev->next = pending->next;
+			}
+			return pending;
 		}
+		prev = pending;
+		pending = pending->next;
+	}
 
-		tnn_tensor_t *t = tnn_alloc(dims, num_dims);
-		t->is_state = true;
+	return NULL;
+}
 
-		fread(t->data, sizeof(float), total_size, fp);
+static tnn_tensor_t *
+_materialize(tnn_state_t *ctx, tnn_pending_entry_t *pending) {
+	tnn_tensor_t *t = _tnn_alloc_mapped(
+	    pending->dims, pending->num_dims, pending->mapping, pending->offset
+	);
+	t->is_state = true;
+	t->requires_grad = true;
+	_insert_state(ctx, pending->key, t);
+	_free_pending(pending);
+	return t;
+}
 
-		free(dims);
+void _tnn_defer_state(
+    const char *key,
+    const size_t *dims,
+    size_t num_dims,
+    tnn_mapping_t *mapping,
+    size_t offset
+) {
+	// prepend active scope to key
+	char full_key[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_key, tnn_state.active_scope, key);
 
-		tnn_set_state(relative_key, t);
+	// newer load wins, same as with eager loading
+	tnn_pending_entry_t *old = _take_pending(&tnn_state, full_key);
+	if (old != NULL) {
+		_free_pending(old);
+	}
+	tnn_tensor_t *old_t = _tnn_take_state(key);
+	if (old_t != NULL) {
+		tnn_free(old_t);
+	}
 
-		free(relative_key);
+	tnn_pending_entry_t *pending = tnn_safe_malloc(sizeof(tnn_pending_entry_t));
+	pending->key = strdup(full_key);
+	pending->num_dims = num_dims;
+	if (num_dims > 0) {
+		pending->dims = tnn_safe_malloc(num_dims * sizeof(size_t));
+		memcpy(pending->dims, dims, num_dims * sizeof(size_t));
+	} else {
+		pending->dims = NULL;
 	}
+	pending->mapping = mapping;
+	_tnn_mapping_retain(mapping);
+	pending->offset = offset;
 
-	fclose(fp);
+	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
+	pending->next = tnn_state.pending_dict[hash];
+	tnn_state.pending_dict[hash] = pending;
 }
 
-size_t tnn_list_state_keys(char **out_keys) {
-	size_t count = 0;
+static void _materialize_scope(tnn_state_t *ctx, const char *scope) {
 	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
-		tnn_state_entry_t *entry = tnn_state.state_dict[i];
-		while (entry != NULL) {
-			// only list keys in current scope
-			if (_tnn_key_in_scope(entry->key, tnn_state.active_scope)) {
-				if (out_keys != NULL) {
-					const char *relative_key =
-					    _tnn_relative_key(entry->key, tnn_state.active_scope);
-					out_keys[count] = (char *)relative_key;
+		tnn_pending_entry_t *pending = ctx->pending_dict[i];
+		tnn_pending_entry_t *prev = NULL;
+
+		while (pending != NULL) {
+			tnn_pending_entry_t *next = pending->next;
+			if (_tnn_key_in_scope(pending->key, scope)) {
+				if (prev == NULL) {
+					ctx->pending_dict[i] = next;
+				} else {
+					prev->next = next;
 				}
-				count++;
+				_materialize(ctx, pending);
+			} else {
+				prev = pending;
 			}
-			entry = entry->next;
+			pending = next;
 		}
 	}
-	return count;
+}
+
+void _tnn_materialize_scope(const char *scope) {
+	_materialize_scope(&tnn_state, scope);
 }
 
 tnn_tensor_t *tnn_get_state(const char *key) {
@@ -201,14 +314,24 @@ tnn_tensor_t *tnn_get_state(const char *key) {
 	char full_key[TNN_STATE_KEY_MAX_LEN];
 	_tnn_cat_keys(full_key, tnn_state.active_scope, key);
 
-	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
-	tnn_state_entry_t *entry = tnn_state.state_dict[hash];
+	tnn_state_t *ctx = &tnn_state;
+	tnn_tensor_t *t = _find_state(ctx, full_key);
+	if (t != NULL) {
+		return t;
+	}
 
-	while (entry != NULL) {
-		if (strcmp(entry->key, full_key) == 0) {
-			return entry->param;
+	// first hit of a lazily loaded tensor
+	tnn_pending_entry_t *pending = _take_pending(ctx, full_key);
+	if (pending != NULL) {
+		return _materialize(ctx, pending);
+	}
+
+	// fall back to shared state, fully materialized by tnn_ctx_create()
+	for (ctx = ctx->shared; ctx != NULL; ctx = ctx->shared) {
+		t = _find_state(ctx, full_key);
+		if (t != NULL) {
+			return t;
 		}
-		entry = entry->next;
 	}
 
 	return NULL;
@@ -219,15 +342,13 @@ void tnn_set_state(const char *key, tnn_tensor_t *t) {
 	char full_key[TNN_STATE_KEY_MAX_LEN];
 	_tnn_cat_keys(full_key, tnn_state.active_scope, key);
 
-	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
-
-	tnn_state_entry_t *entry = tnn_safe_malloc(sizeof(tnn_state_entry_t));
-	entry->key = strdup(full_key); // freed upon release
-	entry->param = t;
-	entry->next = tnn_state.state_dict[hash];
-	// ^ chain with old entry
+	// explicit value overrides anything still pending
+	tnn_pending_entry_t *pending = _take_pending(&tnn_state, full_key);
+	if (pending != NULL) {
+		_free_pending(pending);
+	}
 
-	tnn_state.state_dict[hash] = entry;
+	_insert_state(&tnn_state, full_key, t);
 }
 
 void tnn_drop_state(const char *key) {
@@ -235,6 +356,26 @@ void tnn_drop_state(const char *key) {
 	char abs_scope[TNN_STATE_KEY_MAX_LEN];
 	_tnn_cat_keys(abs_scope, tnn_state.active_scope, key);
 
+	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
+		tnn_pending_entry_t *pending = tnn_state.pending_dict[i];
+		tnn_pending_entry_t *prev_pending = NULL;
+
+		while (pending != NULL) {
+			tnn_pending_entry_t *next = pending->next;
+			if (_tnn_key_in_scope(pending->key, abs_scope)) {
+				if (prev_pending == NULL) {
+					tnn_state.pending_dict[i] = next;
+				} else {
+					prev_pending->next = next;
+				}
+				_free_pending(pending);
+			} else {
+				prev_pending = pending;
+			}
+			pending = next;
+		}
+	}
+
 	for (size_t i = 0; i < TNN_STATE_DICT_SIZE; i++) {
 		tnn_state_entry_t *entry = tnn_state.state_dict[i];
 		tnn_state_entry_t *prev = NULL;
@@ -261,3 +402,39 @@ void tnn_drop_state(const char *key) {
 		}
 	}
 }
+
+tnn_tensor_t *_tnn_take_state(const char *key) {
+	// prepend active scope to key
+	char full_key[TNN_STATE_KEY_MAX_LEN];
+	_tnn_cat_keys(full_key, tnn_state.active_scope, key);
+
+	// materialize first if still pending
+	tnn_pending_entry_t *pending = _take_pending(&tnn_state, full_key);
+	if (pending != NULL) {
+		_materialize(&tnn_state, pending);
+	}
+
+	uint32_t hash = _hash_string(full_key) % TNN_STATE_DICT_SIZE;
+	tnn_state_entry_t *entry = tnn_state.state_dict[hash];
+	tnn_state_entry_t *prev = NULL;
+
+	while (entry != NULL) {
+		if (strcmp(entry->key, full_key) == 0) {
+			if (prev == NULL) {
+				tnn_state.state_dict[hash] = entry->next;
+			} else {
+				prev->next = entry->next;
+			}
+
+			tnn_tensor_t *t = entry->param;
+			t->is_state = false; // caller owns it now
+			free(entry->key);
+			free(entry);
+			return t;
+		}
+		prev = entry;
+		entry = entry->next;
+	}
+
+	return NULL;
+}
@@ -9,9 +9,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "./impl/lazy.h"
 #include "./impl/malloc.h"
-
-tnn_tensor_t *tnn_alloc(const size_t *dims, size_t num_dims) {
+#include "./impl/mapping.h"
+#include "./impl/offload.h"
+#include "./impl/prepack.h"
+#include "./impl/rng.h"
+#include "./impl/state.h"
+
+// everything but data
+static tnn_tensor_t *_tnn_alloc_header(const size_t *dims, size_t num_dims) {
 	tnn_tensor_t *t = tnn_safe_malloc(sizeof(tnn_tensor_t));
 
 	t->num_dims = num_dims;
@@ -22,8 +29,7 @@ tnn_tensor_t *tnn_alloc(const size_t *dims, size_t num_dims) {
 		t->dims = NULL;
 	}
 
-	size_t total_size = tnn_size(t);
-	t->data = tnn_safe_malloc(total_size * sizeof(float));
+	t->data = NULL;
 	t->grad = NULL;
 
 	t->requires_grad = false;
@@ -36,6 +42,42 @@ tnn_tensor_t *tnn_alloc(const size_t *dims, size_t num_dims) {
 	t->context = NULL;
 	t->free_context = NULL;
 
+	t->mapping = NULL;
+
+	t->compact = false;
+	t->compact_parents = 0;
+
+	t->channels = 0;
+
+	t->version = 0;
+	t->packed = NULL;
+
+	return t;
+}
+
+tnn_tensor_t *tnn_alloc(const size_t *dims, size_t num_dims) {
+	tnn_tensor_t *t = _tnn_alloc_header(dims, num_dims);
+
+	size_t total_size = tnn_size(t);
+	t->data = tnn_safe_malloc(total_size * sizeof(float));
+	_tnn_offload_track(t);
+
+	return t;
+}
+
+tnn_tensor_t *_tnn_alloc_deferred(const size_t *dims, size_t num_dims) {
+	return _tnn_alloc_header(dims, num_dims);
+}
+
+tnn_tensor_t *_tnn_alloc_mapped(
+    const size_t *dims, size_t num_dims, tnn_mapping_t *mapping, size_t offset
+) {
+	tnn_tensor_t *t = _tnn_alloc_header(dims, num_dims);
+
+	t->data = (float *)((char *)mapping->addr + offset);
+	t->mapping = mapping;
+	_tnn_mapping_retain(mapping);
+
 	return t;
 }
 
@@ -65,7 +107,7 @@ void tnn_free(tnn_tensor_t *t) {
 	assert(t != NULL);
 
 	// skip freeing t if still referenced
-	if (t->num_children > 0 || t->is_state) {
+	if (t->is_state || t->num_children > 0) {
 		return;
 	}
 
@@ -73,16 +115,23 @@ void tnn_free(tnn_tensor_t *t) {
 	for (size_t i = 0; i < t->num_parents; i++) {
 		tnn_tensor_t *parent = t->parents[i];
 		assert(parent != NULL);
-		parent->num_children--;
+		__atomic_fetch_sub(&parent->num_children, 1, __ATOMIC_RELAXED);
+		// ^ see: _tnn_retain_state()
 		tnn_free(parent);
 	}
 
 	// free current tensor
-	free(t->data);
+	_tnn_offload_forget(t);
+	if (t->mapping != NULL) {
+		_tnn_mapping_release(t->mapping);
+	} else {
+		free(t->data);
+	}
 	if (t->grad) {
 		free(t->grad);
 	}
 	free(t->dims);
+	_tnn_packed_free(t);
 	if (t->context != NULL && t->free_context != NULL) {
 		// (forward was executed without backward)
 		t->free_context(t->context);
@@ -91,8 +140,10 @@ void tnn_free(tnn_tensor_t *t) {
 }
 
 tnn_tensor_t *tnn_detach(tnn_tensor_t *t) {
+	tnn_realize(t);
 	tnn_tensor_t *detached = tnn_alloc(t->dims, t->num_dims);
 	tnn_init_from_memory(detached, t->data);
+	detached->channels = t->channels;
 	return detached;
 }
 
@@ -105,22 +156,18 @@ tnn_tensor_t *tnn_detach_free(tnn_tensor_t *t) {
 void tnn_init_from_memory(tnn_tensor_t *t, const float *data) {
 	size_t total_size = tnn_size(t);
 	memcpy(t->data, data, total_size * sizeof(float));
+	t->version++;
 }
 
 void tnn_init_fill(tnn_tensor_t *t, float value) {
 	size_t total_size = tnn_size(t);
 	memset(t->data, value, total_size * sizeof(float));
+	t->version++;
 }
 
 void tnn_init_randn(tnn_tensor_t *t) {
-	size_t total_size = tnn_size(t);
-	for (size_t i = 0; i < total_size; i++) {
-		// box-muller transform for normal distribution
-		float u1 = (float)rand() / (float)RAND_MAX;
-		float u2 = (float)rand() / (float)RAND_MAX;
-		float z = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
-		t->data[i] = z;
-	}
+	_tnn_fill_normal(t->data, tnn_size(t), _tnn_next_stream());
+	t->version++;
 }
 
 size_t tnn_dim(tnn_tensor_t *t, int32_t i_dim) {
@@ -152,6 +199,7 @@ size_t tnn_index_at(tnn_tensor_t *t, size_t *indices, size_t num_indices) {
 
 void tnn_print(tnn_tensor_t *t) {
 	assert(t->num_dims <= 2 && "tnn_print: only 0D/1D/2D supported");
+	tnn_realize(t);
 
 	if (t->num_dims == 0) {
 		printf("%.4f", t->data[0]);
@@ -185,5 +233,6 @@ void tnn_print(tnn_tensor_t *t) {
 }
 
 float tnn_item(tnn_tensor_t *t) {
+	tnn_realize(t);
 	return t->data[0];
 }